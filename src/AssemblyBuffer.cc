@@ -0,0 +1,32 @@
+#include "AssemblyBuffer.h"
+
+void AssemblyBuffer::add(const DenseMatrix<Number> & Ke, const DenseVector<Number> & Fe, const std::vector<dof_id_type> & dof_indices)
+{
+    contributions_.push_back(Contribution());
+    
+    Contribution & contribution = contributions_.back();
+    
+    contribution.Ke          = Ke;
+    contribution.Fe          = Fe;
+    contribution.dof_indices = dof_indices;
+    contribution.has_matrix  = true;
+}
+
+void AssemblyBuffer::add(const DenseVector<Number> & Fe, const std::vector<dof_id_type> & dof_indices)
+{
+    contributions_.push_back(Contribution());
+    
+    Contribution & contribution = contributions_.back();
+    
+    contribution.Fe          = Fe;
+    contribution.dof_indices = dof_indices;
+    contribution.has_matrix  = false;
+}
+
+void AssemblyBuffer::addAuxiliary(const DenseMatrix<Number> & Me, const std::vector<dof_id_type> & dof_indices)
+{
+    libmesh_assert(!contributions_.empty());
+    
+    contributions_.back().Me              = Me;
+    contributions_.back().dof_indices_aux = dof_indices;
+}
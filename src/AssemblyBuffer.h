@@ -0,0 +1,91 @@
+/* C++ */
+
+/**
+ * @file   AssemblyBuffer.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef ASSEMBLYBUFFER_H
+#define ASSEMBLYBUFFER_H
+
+#include "typedefs.h"
+
+/**
+ * @class AssemblyBuffer
+ *
+ * @brief Classe che raccoglie i contributi elementari assemblati da un thread
+ *
+ * I thread calcolano le matrici elementari in parallelo senza toccare il sistema globale;
+ * i contributi raccolti vengono inseriti in serie al termine del ciclo, senza un lock per ogni elemento.
+ *
+ */
+class AssemblyBuffer
+{
+    public:
+        /**
+         * @struct Contribution
+         * @brief Contributo di un elemento
+         *
+         */
+        struct Contribution
+        {
+            DenseMatrix<Number> Ke;                     /**< @brief matrice elementare, già vincolata */
+            DenseVector<Number> Fe;                     /**< @brief termine noto elementare, già vincolato */
+            std::vector<dof_id_type> dof_indices;       /**< @brief indici globali dei gradi di libertà dell'elemento */
+            bool has_matrix;                            /**< @brief falso se il contributo riguarda il solo termine noto */
+            
+            DenseMatrix<Number> Me;                     /**< @brief matrice ausiliaria dell'elemento, ad esempio per un precondizionatore */
+            std::vector<dof_id_type> dof_indices_aux;   /**< @brief indici globali dei gradi di libertà della matrice ausiliaria */
+        };
+        
+        /**
+         * @brief Aggiunge il contributo di un elemento
+         * @param[in] Ke          : matrice elementare, già vincolata
+         * @param[in] Fe          : termine noto elementare, già vincolato
+         * @param[in] dof_indices : indici globali dei gradi di libertà dell'elemento
+         *
+         */
+        void add(const DenseMatrix<Number> &, const DenseVector<Number> &, const std::vector<dof_id_type> &);
+        
+        /**
+         * @brief Aggiunge il contributo di un elemento al solo termine noto
+         * @param[in] Fe          : termine noto elementare, già vincolato
+         * @param[in] dof_indices : indici globali dei gradi di libertà dell'elemento
+         *
+         */
+        void add(const DenseVector<Number> &, const std::vector<dof_id_type> &);
+        
+        /**
+         * @brief Associa una matrice ausiliaria all'ultimo contributo aggiunto
+         * @param[in] Me          : matrice ausiliaria dell'elemento
+         * @param[in] dof_indices : indici globali dei gradi di libertà della matrice ausiliaria
+         *
+         */
+        void addAuxiliary(const DenseMatrix<Number> &, const std::vector<dof_id_type> &);
+        
+        /**
+         * @brief Restituisce i contributi raccolti
+         * @return i contributi, nell'ordine in cui sono stati aggiunti
+         *
+         */
+        inline const std::vector<Contribution> & get_contributions() const;
+        
+    private:
+        std::vector<Contribution> contributions_;   /**< @brief contributi raccolti */
+};
+
+inline const std::vector<AssemblyBuffer::Contribution> & AssemblyBuffer::get_contributions() const
+{
+    return contributions_;
+}
+
+#endif /* ASSEMBLYBUFFER_H */
@@ -0,0 +1,64 @@
+#include "BSplineBasis.h"
+
+BSplineBasis::BSplineBasis(const Index & n_intervals, const Index & degree)
+    : n_intervals_(n_intervals), degree_(degree), knots_(n_intervals + degree + 2)
+{
+    if ( degree_ < 1 || degree_ > n_intervals_ )
+    {
+        throw std::runtime_error("BSplineBasis(): the degree must be between 1 and the number of subdivisions.");
+    }
+    
+    const Index n_spans = n_intervals_ - degree_ + 1;
+    
+    for ( Index j = 0; j < knots_.size(); ++j )
+    {
+        knots_(j) = std::min<Real>(1.0, std::max<Real>(0.0, static_cast<Real>(j - degree_) / n_spans));
+    }
+}
+
+Index BSplineBasis::get_size() const
+{
+    return n_intervals_ + 1;
+}
+
+Index BSplineBasis::findSpan(const Real & t) const
+{
+    // The interior knots are uniform, hence the span is found without a search.
+    const Index n_spans = n_intervals_ - degree_ + 1;
+    
+    const Index span = degree_ + static_cast<Index>(std::floor(t * n_spans));
+    
+    return std::min(n_intervals_, std::max(degree_, span));
+}
+
+void BSplineBasis::evaluateNonZero(const Real & t, Index & first, VectorXr & values) const
+{
+    const Index span = findSpan(t);
+    
+    first = span - degree_;
+    values.resize(degree_ + 1);
+    
+    VectorXr left(degree_ + 1);
+    VectorXr right(degree_ + 1);
+    
+    values(0) = 1.0;
+    
+    // Cox-de Boor recursion on the p + 1 functions that do not vanish in the span.
+    for ( Index j = 1; j <= degree_; ++j )
+    {
+        left(j)  = t - knots_(span + 1 - j);
+        right(j) = knots_(span + j) - t;
+        
+        Real saved = 0.0;
+        
+        for ( Index r = 0; r < j; ++r )
+        {
+            const Real temp = values(r) / (right(r + 1) + left(j - r));
+            
+            values(r) = saved + right(r + 1) * temp;
+            saved = left(j - r) * temp;
+        }
+        
+        values(j) = saved;
+    }
+}
@@ -0,0 +1,84 @@
+/* C++ */
+
+/**
+ * @file   BSplineBasis.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef BSPLINEBASIS_H
+#define BSPLINEBASIS_H
+
+#include "UnivariateBasis.h"
+
+/**
+ * @class BSplineBasis
+ *
+ * @brief Classe che valuta le B-spline univariate di grado @f$ p @f$ su un vettore dei nodi uniforme e clamped
+ *
+ * Le @f$ n + 1 @f$ funzioni sono definite sui nodi
+ * @f[
+ *    \underbrace{0, \dots, 0}_{p + 1}, \frac{1}{n - p + 1}, \dots, \frac{n - p}{n - p + 1}, \underbrace{1, \dots, 1}_{p + 1}
+ * @f]
+ * e in ogni punto solo @f$ p + 1 @f$ di esse sono diverse da zero: vengono calcolate con la ricorrenza di Cox-de Boor
+ * in @f$ O(p^2) @f$ operazioni. Per @f$ p = n @f$ si ritrovano i polinomi di Bernstein di grado @f$ n @f$.
+ *
+ */
+class BSplineBasis : public UnivariateBasis
+{
+    public:
+        /**
+         * @brief Costruttore
+         * @param[in] n_intervals : numero @f$ n @f$ di suddivisioni: le funzioni sono @f$ n + 1 @f$
+         * @param[in] degree      : grado @f$ p \le n @f$ delle B-spline
+         *
+         */
+        BSplineBasis(const Index &, const Index &);
+        
+        /**
+         * @brief Restituisce il grado delle B-spline
+         * @return il grado
+         *
+         */
+        inline Index get_degree() const;
+        
+        /** @copydoc UnivariateBasis::get_size() */
+        virtual Index get_size() const;
+        
+        /**
+         * @brief Valuta le @f$ p + 1 @f$ B-spline non nulle in un punto
+         * @param[in]  t      : punto in @f$ [0, 1] @f$
+         * @param[out] first  : indice della prima B-spline non nulla
+         * @param[out] values : vettore di @f$ p + 1 @f$ componenti con i valori delle B-spline non nulle
+         *
+         */
+        virtual void evaluateNonZero(const Real &, Index &, VectorXr &) const;
+        
+    private:
+        /**
+         * @brief Cerca l'intervallo dei nodi che contiene il punto
+         * @param[in] t : punto in @f$ [0, 1] @f$
+         * @return l'indice @f$ i @f$ tale che @f$ t \in [u_i, u_{i + 1}) @f$, con @f$ p \le i \le n @f$
+         *
+         */
+        Index findSpan(const Real &) const;
+        
+        Index n_intervals_;     /**< @brief numero @f$ n @f$ di suddivisioni */
+        Index degree_;          /**< @brief grado @f$ p @f$ delle B-spline */
+        VectorXr knots_;        /**< @brief vettore dei nodi, di @f$ n + p + 2 @f$ componenti */
+};
+
+inline Index BSplineBasis::get_degree() const
+{
+    return degree_;
+}
+
+#endif /* BSPLINEBASIS_H */
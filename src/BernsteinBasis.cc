@@ -0,0 +1,44 @@
+#include "BernsteinBasis.h"
+
+BernsteinBasis::BernsteinBasis(const Index & degree)
+    : degree_(degree), binomials_(degree + 1)
+{
+    for ( Index k = 0; k <= degree_; ++k )
+    {
+        binomials_(k) = binomial_coefficient<Real>(degree_, k);
+    }
+}
+
+Index BernsteinBasis::get_size() const
+{
+    return degree_ + 1;
+}
+
+void BernsteinBasis::evaluateNonZero(const Real & t, Index & first, VectorXr & values) const
+{
+    first = 0;
+    values.resize(degree_ + 1);
+    
+    // Increasing powers of t...
+    Real power = 1.0;
+    
+    for ( Index k = 0; k <= degree_; ++k )
+    {
+        values(k) = binomials_(k) * power;
+        power *= t;
+    }
+    
+    // ... times decreasing powers of 1 - t.
+    power = 1.0;
+    
+    for ( Index k = degree_; k >= 0; --k )
+    {
+        values(k) *= power;
+        power *= 1.0 - t;
+    }
+}
+
+Real BernsteinBasis::value(const Real & t, const Index & k) const
+{
+    return binomials_(k) * std::pow(t, k) * std::pow(1.0 - t, degree_ - k);
+}
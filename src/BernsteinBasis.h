@@ -0,0 +1,82 @@
+/* C++ */
+
+/**
+ * @file   BernsteinBasis.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef BERNSTEINBASIS_H
+#define BERNSTEINBASIS_H
+
+#include "UnivariateBasis.h"
+
+/**
+ * @class BernsteinBasis
+ *
+ * @brief Classe che valuta i polinomi di Bernstein univariati di un grado fissato
+ *
+ * @f[
+ *    b_k^n (t) = \binom{n}{k} t^k (1 - t)^{n - k}, \qquad k = 0, \dots, n
+ * @f]
+ * I coefficienti binomiali vengono calcolati una sola volta nel costruttore; tutti gli @f$ n + 1 @f$ polinomi
+ * in un punto vengono valutati insieme, accumulando le potenze di @f$ t @f$ e di @f$ 1 - t @f$ senza chiamare @c std::pow.
+ *
+ */
+class BernsteinBasis : public UnivariateBasis
+{
+    public:
+        /**
+         * @brief Costruttore
+         * @param[in] degree : grado dei polinomi
+         *
+         */
+        BernsteinBasis(const Index & = 0);
+        
+        /**
+         * @brief Restituisce il grado dei polinomi
+         * @return il grado
+         *
+         */
+        inline Index get_degree() const;
+        
+        /** @copydoc UnivariateBasis::get_size() */
+        virtual Index get_size() const;
+        
+        /**
+         * @brief Valuta tutti i polinomi in un punto: nessuno di essi è nullo in @f$ (0, 1) @f$
+         * @param[in]  t      : punto in @f$ [0, 1] @f$
+         * @param[out] first  : sempre zero
+         * @param[out] values : vettore di @f$ n + 1 @f$ componenti con i valori @f$ b_k^n (t) @f$
+         *
+         */
+        virtual void evaluateNonZero(const Real &, Index &, VectorXr &) const;
+        
+        /**
+         * @brief Valuta un singolo polinomio in un punto
+         * @param[in] t : punto in @f$ [0, 1] @f$
+         * @param[in] k : indice del polinomio
+         * @return il valore di @f$ b_k^n (t) @f$
+         *
+         */
+        virtual Real value(const Real &, const Index &) const;
+        
+    private:
+        Index degree_;          /**< @brief grado dei polinomi */
+        VectorXr binomials_;    /**< @brief coefficienti binomiali @f$ \binom{n}{k} @f$ */
+};
+
+inline Index BernsteinBasis::get_degree() const
+{
+    return degree_;
+}
+
+#endif /* BERNSTEINBASIS_H */
@@ -10,51 +10,28 @@ void BoundaryDisplacement::computePerturbation(EquationSystems & perturbation, E
 
 void BoundaryDisplacement::applyPerturbation(const EquationSystems & perturbation)
 {
-    Mesh::const_element_iterator       el     = mesh_->active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh_->active_local_elements_end();
+    // The displacement is read at the nodal DOFs, without locating the nodes in the perturbation mesh:
+    // the two meshes share the node numbering.
+    const System & system = perturbation.get_system("Perturbation");
+    const MeshBase & perturbation_mesh = perturbation.get_mesh();
     
-    std::vector<bool> hasMoved(mesh_->n_nodes(), false);
+    std::vector<Number> displacement;
+    system.solution->localize(displacement);
     
-    for ( ; el != end_el ; ++el )
+    const unsigned int u_var = system.variable_number ("u");
+    const unsigned int v_var = system.variable_number ("v");
+    
+    const std::vector<dof_id_type> & vertices = deformer_.get_vertices();
+    
+    MatrixXr displacements(vertices.size(), mesh_->mesh_dimension());
+    
+    for ( std::size_t v = 0; v < vertices.size(); ++v )
     {
-        const Elem * elem = *el;
-        Node * node;
-        Index subPerSide = elem->n_nodes() / 3 - 1;
+        const Node & perturbation_node = perturbation_mesh.node(vertices[v]);
         
-        for ( Index n = 0; n < elem->n_vertices(); ++n ) // loop over vertices
-        {
-            node = elem->get_node(n);
-            
-            if ( !hasMoved[node->id()] && problem_.toBeMoved(*node) )
-            {
-                for ( Index c = 0; c < mesh_->mesh_dimension(); ++c )
-                {
-                    (*node)(c) += step_ * (perturbation.get_system("Perturbation").point_value(c, *node));
-                }
-                
-                hasMoved[node->id()] = true;
-            }
-        }
-        
-        for ( Index n = elem->n_vertices(); n < elem->n_nodes(); ++n ) // loop over non-vertices
-        {
-            node = elem->get_node(n);
-            
-            if ( !hasMoved[node->id()] && problem_.toBeMoved(*node) )
-            {
-                Index idA = (n - 3) / subPerSide;              // ID del vertice precedente.
-                Index idB = ((n - 3 + 1) / subPerSide) % 3;    // ID del vertice successivo.
-                
-                Point * node1 = elem->get_node(idA);
-                Point * node2 = elem->get_node(idB);
-                
-                for ( Index c = 0; c < mesh_->mesh_dimension(); ++c )
-                {
-                    (*node)(c) = 1.0 / (subPerSide + 1) * ((n - 3) - subPerSide * idA + 1) * ( (*node1)(c) + (*node2)(c) ); // 1/(#nodi per lato+1) * (che ordinamento ha il nodo nel lato) * (incremento)
-                }
-                
-                hasMoved[node->id()] = true;
-            }
-        }
+        displacements(v, 0) = step_ * displacement[perturbation_node.dof_number(system.number(), u_var, 0)];
+        displacements(v, 1) = step_ * displacement[perturbation_node.dof_number(system.number(), v_var, 0)];
     }
+    
+    deformer_.displaceVertices(*mesh_, displacements);
 }
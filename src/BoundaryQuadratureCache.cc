@@ -0,0 +1,79 @@
+#include "BoundaryQuadratureCache.h"
+
+#include <algorithm>
+
+bool BoundaryQuadratureCache::Side::has_boundary_id(const boundary_id_type & id) const
+{
+    return ( std::find(boundary_ids.begin(), boundary_ids.end(), id) != boundary_ids.end() );
+}
+
+BoundaryQuadratureCache::BoundaryQuadratureCache(const FEType & fe_type, const Order & order)
+    : fe_type_(fe_type), order_(order), mesh_(NULL), n_points_(0) {}
+
+void BoundaryQuadratureCache::reinit(const MeshBase & mesh)
+{
+    const unsigned int dim = mesh.mesh_dimension();
+    
+    AutoPtr<FEBase> fe_face (FEBase::build(dim, fe_type_));
+    QGauss qface(dim - 1, order_);
+    fe_face->attach_quadrature_rule (&qface);
+    
+    const std::vector<Point> & qface_point = fe_face->get_xyz();
+    const std::vector<Real> & JxW_face = fe_face->get_JxW();
+    const std::vector<Point> & face_normals = fe_face->get_normals();
+    const std::vector<std::vector<Real> > & phi_face = fe_face->get_phi();
+    const std::vector<std::vector<RealGradient> > & dphi_face = fe_face->get_dphi();
+    
+    sides_.clear();
+    elem_ranges_.assign(mesh.max_elem_id(), std::make_pair(0, 0));
+    
+    MeshBase::const_element_iterator       el     = mesh.active_local_elements_begin();
+    const MeshBase::const_element_iterator end_el = mesh.active_local_elements_end();
+    
+    for ( ; el != end_el; ++el)
+    {
+        const Elem * elem = *el;
+        
+        for (unsigned int side = 0; side < elem->n_sides(); side++)
+        {
+            if (elem->neighbor(side) == NULL)
+            {
+                fe_face->reinit(elem, side);
+                
+                Side s;
+                s.elem = elem;
+                s.side = side;
+                s.boundary_ids = mesh.boundary_info->boundary_ids(elem, side);
+                
+                s.xyz     = qface_point;
+                s.JxW     = JxW_face;
+                s.normals = face_normals;
+                s.phi     = phi_face;
+                s.dphi    = dphi_face;
+                
+                // The sides of an element are stored contiguously.
+                if ( elem_ranges_[elem->id()].first == elem_ranges_[elem->id()].second )
+                {
+                    elem_ranges_[elem->id()].first = sides_.size();
+                }
+                
+                sides_.push_back(s);
+                
+                elem_ranges_[elem->id()].second = sides_.size();
+            }
+        }
+    }
+    
+    n_points_ = qface.n_points();
+    mesh_ = &mesh;
+}
+
+void BoundaryQuadratureCache::clear()
+{
+    mesh_ = NULL;
+}
+
+bool BoundaryQuadratureCache::isValid(const MeshBase & mesh) const
+{
+    return ( mesh_ == &mesh );
+}
@@ -0,0 +1,164 @@
+/* C++ */
+
+/**
+ * @file   BoundaryQuadratureCache.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef BOUNDARYQUADRATURECACHE_H
+#define BOUNDARYQUADRATURECACHE_H
+
+#include "typedefs.h"
+
+/**
+ * @class BoundaryQuadratureCache
+ *
+ * @brief Classe che memorizza i dati di quadratura di tutti i lati di bordo di una mesh
+ *
+ * Per ogni lato di bordo vengono salvati nodi di quadratura, pesi, normali, funzioni di base
+ * con i relativi gradienti e identificativi di bordo. I dati dipendono solo dalla geometria:
+ * la cache va ricostruita (o invalidata con clear()) ogni volta che i nodi della mesh vengono spostati.
+ *
+ */
+class BoundaryQuadratureCache
+{
+    public:
+        /**
+         * @struct Side
+         * @brief Dati di quadratura relativi a un singolo lato di bordo
+         *
+         */
+        struct Side
+        {
+            const Elem * elem;                                  /**< @brief elemento a cui appartiene il lato */
+            unsigned int side;                                  /**< @brief indice locale del lato nell'elemento */
+            
+            std::vector<boundary_id_type> boundary_ids;         /**< @brief identificativi di bordo del lato */
+            
+            std::vector<Point> xyz;                             /**< @brief nodi di quadratura */
+            std::vector<Real> JxW;                              /**< @brief pesi di quadratura */
+            std::vector<Point> normals;                         /**< @brief normali uscenti nei nodi di quadratura */
+            std::vector<std::vector<Real> > phi;                /**< @brief funzioni di base nei nodi di quadratura */
+            std::vector<std::vector<RealGradient> > dphi;       /**< @brief gradienti delle funzioni di base nei nodi di quadratura */
+            
+            /**
+             * @brief Verifica se il lato appartiene al bordo richiesto
+             * @param[in] id : identificativo di bordo
+             * @return vero se il lato ha l'identificativo @a id
+             *
+             */
+            bool has_boundary_id(const boundary_id_type &) const;
+        };
+        
+        /**
+         * @brief Costruttore
+         * @param[in] fe_type : Tipo di elemento finito di cui memorizzare le funzioni di base
+         * @param[in] order   : Ordine della formula di quadratura di Gauss sui lati
+         *
+         */
+        BoundaryQuadratureCache(const FEType &, const Order &);
+        
+        /**
+         * @brief Calcola i dati di quadratura per tutti i lati di bordo della mesh
+         * @param[in] mesh : mesh di cui considerare il bordo
+         *
+         */
+        void reinit(const MeshBase &);
+        
+        /**
+         * @brief Invalida la cache
+         *
+         */
+        void clear();
+        
+        /**
+         * @brief Verifica se la cache è aggiornata per la mesh richiesta
+         * @param[in] mesh : mesh su cui si vogliono usare i dati
+         * @return vero se la cache è stata costruita su @a mesh e non è stata invalidata
+         *
+         */
+        bool isValid(const MeshBase &) const;
+        
+        /**
+         * @brief Restituisce i lati di bordo, nell'ordine di visita degli elementi attivi
+         * @return il vettore dei lati di bordo
+         *
+         */
+        inline const std::vector<Side> & get_sides() const;
+        
+        /**
+         * @brief Restituisce l'intervallo dei lati di bordo di un elemento
+         * @param[in] elem_id : identificativo dell'elemento
+         * @return la coppia (primo, ultimo + 1) di indici in get_sides()
+         *
+         */
+        inline std::pair<Index, Index> get_sides(const dof_id_type &) const;
+        
+        /**
+         * @brief Restituisce il tipo di elemento finito delle funzioni di base memorizzate
+         * @return il tipo di elemento finito
+         *
+         */
+        inline const FEType & get_fe_type() const;
+        
+        /**
+         * @brief Restituisce l'ordine della formula di quadratura sui lati
+         * @return l'ordine della formula di quadratura
+         *
+         */
+        inline const Order & get_quadrature_order() const;
+        
+        /**
+         * @brief Restituisce il numero di nodi di quadratura per lato
+         * @return il numero di nodi di quadratura
+         *
+         */
+        inline unsigned int n_points() const;
+        
+    private:
+        FEType fe_type_;                    /**< @brief tipo di elemento finito */
+        Order order_;                       /**< @brief ordine della formula di quadratura sui lati */
+        
+        const MeshBase * mesh_;             /**< @brief mesh su cui è stata costruita la cache, NULL se non valida */
+        
+        std::vector<Side> sides_;           /**< @brief dati dei lati di bordo */
+        std::vector<std::pair<Index, Index> > elem_ranges_;   /**< @brief per ogni elemento, intervallo dei suoi lati di bordo in @a sides_ */
+        
+        unsigned int n_points_;             /**< @brief numero di nodi di quadratura per lato */
+};
+
+inline const std::vector<BoundaryQuadratureCache::Side> & BoundaryQuadratureCache::get_sides() const
+{
+    return sides_;
+}
+
+inline std::pair<Index, Index> BoundaryQuadratureCache::get_sides(const dof_id_type & elem_id) const
+{
+    return elem_ranges_[elem_id];
+}
+
+inline const FEType & BoundaryQuadratureCache::get_fe_type() const
+{
+    return fe_type_;
+}
+
+inline const Order & BoundaryQuadratureCache::get_quadrature_order() const
+{
+    return order_;
+}
+
+inline unsigned int BoundaryQuadratureCache::n_points() const
+{
+    return n_points_;
+}
+
+#endif /* BOUNDARYQUADRATURECACHE_H */
@@ -34,115 +34,60 @@ DesignElement::DesignElement(const Problem & problem, const std::string & direct
 
 void DesignElement::computePerturbation(EquationSystems & perturbation, EquationSystems & stateAdj)
 {
-    const unsigned int dim = reference_mesh_.mesh_dimension();
-    LinearImplicitSystem & system = stateAdj.get_system<LinearImplicitSystem>(problem_.get_name());
+    const BoundaryQuadratureCache & cache = problem_.get_boundary_cache(stateAdj.get_mesh());
+    const std::vector<BoundaryQuadratureCache::Side> & sides = cache.get_sides();
     
-    const DofMap& dof_map = system.get_dof_map();
-    
-    FEType fe_type = dof_map.variable_type(0);
-    AutoPtr<FEBase> fe (FEBase::build(dim, fe_type));
-    QGauss qrule (dim, fe_type.default_quadrature_order());
-    fe->attach_quadrature_rule (&qrule);
-    
-    AutoPtr<FEBase> fe_face (FEBase::build(dim, fe_type));
-    QGauss qface(dim - 1, fe_type.default_quadrature_order());
-    fe_face->attach_quadrature_rule (&qface);
-    
-    Index quadNodesNo = qface.n_points();
-    Index count = 0;
+    const unsigned int quadNodesNo = cache.n_points();
     
     if ( firstTime_ )
     {
         firstTime_ = false;
         
-        Mesh::const_element_iterator       ref_el     = reference_mesh_.active_local_elements_begin();
-        const Mesh::const_element_iterator ref_end_el = reference_mesh_.active_local_elements_end();
-        
-        // Conta numero di lati di bordo e numero di nodi di quadratura per ogni lato.
-        Index edgesNo = 0;
-        
-        for ( ; ref_el != ref_end_el; ++ref_el)
-        {
-            const Elem * elem = *ref_el;
-            
-            for (unsigned int side = 0; side < elem->n_sides(); side++)
-            {
-                if (elem->neighbor(side) == NULL)
-                {
-                    ++edgesNo;
-                }
-            }
-        }
+        // Nodi di quadratura nella mesh di riferimento, nello stesso ordine dei lati di bordo della mesh corrente.
+        BoundaryQuadratureCache reference_cache(cache.get_fe_type(), cache.get_quadrature_order());
+        reference_cache.reinit(reference_mesh_);
         
-        // Nodi di quadratura nella mesh di riferimento.
-        reference_nodes_.resize( edgesNo * quadNodesNo );
+        const std::vector<BoundaryQuadratureCache::Side> & reference_sides = reference_cache.get_sides();
         
-        ref_el = reference_mesh_.active_local_elements_begin(); // Resetta iteratore.
+        reference_nodes_.resize( reference_sides.size() * quadNodesNo );
         
-        for ( ; ref_el != ref_end_el; ++ref_el)
+        for (std::size_t count = 0; count < reference_sides.size(); ++count)
         {
-            const Elem * elem = *ref_el;
-            
-            for (unsigned int side = 0; side < elem->n_sides(); side++)
+            for (unsigned int qp = 0; qp < quadNodesNo; qp++)
             {
-                if (elem->neighbor(side) == NULL)
-                {
-                    const std::vector<Point> & qface_point = fe_face->get_xyz();
-                    fe_face->reinit(elem, side);
-                    
-                    for (unsigned int qp = 0; qp < qface.n_points(); qp++)
-                    {
-                        reference_nodes_(count * quadNodesNo + qp) = qface_point[qp];
-                    }
-                    
-                    ++count;
-                }
+                reference_nodes_(count * quadNodesNo + qp) = reference_sides[count].xyz[qp];
             }
         }
     }
     
     Real H = boundingBox_.second(1) - boundingBox_.first(1);
     
-    // Gradiente del funzionale costo.
-    Mesh::const_element_iterator       el     = mesh_->active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh_->active_local_elements_end();
-    
-    count = 0;
+    std::vector<Real> gradient;
     
-    for ( ; el != end_el; ++el)
+    // Gradiente del funzionale costo.
+    for (std::size_t count = 0; count < sides.size(); ++count)
     {
-        const Elem * elem = *el;
+        const BoundaryQuadratureCache::Side & side = sides[count];
         
-        for (unsigned int side = 0; side < elem->n_sides(); side++)
+        problem_.computeGradient(stateAdj, side, gradient);
+        
+        for (unsigned int qp = 0; qp < quadNodesNo; qp++)
         {
-            if (elem->neighbor(side) == NULL)
+            Point p = psi( reference_nodes_(count * quadNodesNo + qp) );
+            
+            Real g = gradient[qp] + actual_lagrange_;
+            
+            for ( Index k = 0; k < gradJ_.size() / 2; ++k )
             {
-                const std::vector<Real> & JxW_face = fe_face->get_JxW();
-                const std::vector<Point> & face_normals = fe_face->get_normals();
-                const std::vector<Point> & qface_point = fe_face->get_xyz();
-                fe_face->reinit(elem, side);
+                Real x = p(0);
                 
-                for (unsigned int qp = 0; qp < qface.n_points(); qp++)
+                for ( Index i = 0; i < k; ++i )
                 {
-                    Point p = psi( reference_nodes_(count * quadNodesNo + qp) );
-                    
-                    Real g = problem_.computeGradient(stateAdj, qface_point[qp]) + actual_lagrange_;
-                    
-                    for ( Index k = 0; k < gradJ_.size() / 2; ++k )
-                    {
-                        Real x = p(0);
-                        
-                        for ( Index i = 0; i < k; ++i )
-                        {
-                            x *= p(0);
-                        }
-                        
-                        gradJ_(k) += g * p(1) * x * JxW_face[qp] * face_normals[qp](1);
-                        gradJ_(gradJ_.size() / 2 + k) += g * (H - p(1)) * x * JxW_face[qp] * face_normals[qp](1);
-                    }
+                    x *= p(0);
                 }
                 
-                ++count;
+                gradJ_(k) += g * p(1) * x * side.JxW[qp] * side.normals[qp](1);
+                gradJ_(gradJ_.size() / 2 + k) += g * (H - p(1)) * x * side.JxW[qp] * side.normals[qp](1);
             }
         }
     }
@@ -154,60 +99,31 @@ void DesignElement::applyPerturbation(const EquationSystems & perturbation)
 {
     mu_ -= step_ * gradJ_;
     
-    Mesh::const_element_iterator       ref_el     = reference_mesh_.active_local_elements_begin();
-    const Mesh::const_element_iterator ref_end_el = reference_mesh_.active_local_elements_end();
+    const std::vector<dof_id_type> & vertices = deformer_.get_vertices();
     
-    Mesh::const_element_iterator       el     = mesh_->active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh_->active_local_elements_end();
+    MatrixXr positions(vertices.size(), mesh_->mesh_dimension());
     
-    std::vector<bool> hasMoved(mesh_->n_nodes(), false);
-    
-    for ( ; ref_el != ref_end_el, el != end_el ; ++ref_el, ++el )
+    for ( std::size_t v = 0; v < vertices.size(); ++v )
     {
-        const Elem * ref_elem = *ref_el;
-        const Elem * elem     = *el;
-        
-        Node * ref_node;
-        Node * node;
+        const Point deformed = deform( reference_mesh_.point(vertices[v]) );
         
-        Index subPerSide = elem->n_nodes() / 3 - 1;
-        
-        for ( Index n = 0; n < elem->n_vertices(); ++n ) // loop over vertices
+        for ( Index i = 0; i < mesh_->mesh_dimension(); ++i )
         {
-            ref_node = ref_elem->get_node(n);
-            node     = elem->get_node(n);
-            
-            if ( !hasMoved[node->id()] && problem_.toBeMoved(*node) )
-            {
-                (*node) = deform( (*ref_node) );
-                
-                hasMoved[node->id()] = true;
-            }
-        }
-        
-        for ( Index n = elem->n_vertices(); n < elem->n_nodes(); ++n ) // loop over non-vertices
-        {
-            node = elem->get_node(n);
-            
-            if ( !hasMoved[node->id()] && problem_.toBeMoved(*node) )
-            {
-                Index idA = (n - 3) / subPerSide;              // ID del vertice precedente.
-                Index idB = ((n - 3 + 1) / subPerSide) % 3;    // ID del vertice successivo.
-                
-                Point * node1 = elem->get_node(idA);
-                Point * node2 = elem->get_node(idB);
-                
-                for ( Index c = 0; c < mesh_->mesh_dimension(); ++c )
-                {
-                    (*node)(c) = 1.0 / (subPerSide + 1) * ((n - 3) - subPerSide * idA + 1) * ( (*node1)(c) + (*node2)(c) ); // 1/(#nodi per lato+1) * (che ordinamento ha il nodo nel lato) * (incremento)
-                }
-                
-                hasMoved[node->id()] = true;
-            }
+            positions(v, i) = deformed(i);
         }
     }
     
-    //mesh_->write("DeformedMesh.vtu");
+    deformer_.setVertices(*mesh_, positions);
+}
+
+void DesignElement::saveParameters()
+{
+    mu_old_ = mu_;
+}
+
+void DesignElement::restoreParameters()
+{
+    mu_ = mu_old_;
 }
 
 Point DesignElement::psi(const Point & point) const
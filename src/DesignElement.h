@@ -58,6 +58,12 @@ class DesignElement : public ShapeOptimization
          */
         virtual void applyPerturbation(const EquationSystems &);
         
+        /** @copydoc ShapeOptimization::saveParameters() */
+        virtual void saveParameters();
+        
+        /** @copydoc ShapeOptimization::restoreParameters() */
+        virtual void restoreParameters();
+        
         /**
          * @brief mappa la scatola nel quadrato unitario
          * @param[in] point : punto nella scatola da trasformare
@@ -89,6 +95,7 @@ class DesignElement : public ShapeOptimization
         std::pair<Point, Point> boundingBox_;       /**< @brief coppia contenente i punti nord est e sud ovest che definiscono la scatola */
         
         VectorXr mu_;                               /**< @brief vettore contenente i coefficienti dei polinomi @f$ f_{up}, f_{down} @f$ */
+        VectorXr mu_old_;                           /**< @brief valore di @a mu_ prima del passo di prova, ripristinato se la regola di Armijo lo rifiuta */
         VectorXr gradJ_;                            /**< @brief vettore contenente il gradiente ridotto rispetto a @a mu_ */
         
         MatrixXr P_;                                /**< @brief matrice di proiezione per fissare gli estremi */
@@ -0,0 +1,125 @@
+#include "DirectSolver.h"
+
+DirectSolver::DirectSolver(const bool & symmetric)
+    : symmetric_(symmetric), analyzed_nonzeros_(-1) {}
+
+void DirectSolver::begin(const System & system)
+{
+    if ( system.n_processors() > 1 )
+    {
+        throw std::runtime_error("DirectSolver::begin(): the direct solver only supports serial runs.");
+    }
+    
+    const Index n_dofs = system.n_dofs();
+    
+    // The number of contributions does not change between two assemblies.
+    const std::size_t n_triplets = triplets_.size();
+    
+    triplets_.clear();
+    triplets_.reserve(n_triplets);
+    
+    rhs_ = VectorXr::Zero(n_dofs);
+    
+    if ( matrix_.rows() != n_dofs )
+    {
+        matrix_.resize(n_dofs, n_dofs);
+        analyzed_nonzeros_ = -1;
+    }
+}
+
+void DirectSolver::add(const DenseMatrix<Number> & Ke, const DenseVector<Number> & Fe, const std::vector<dof_id_type> & dof_indices)
+{
+    for (unsigned int i = 0; i < dof_indices.size(); i++)
+    {
+        for (unsigned int j = 0; j < dof_indices.size(); j++)
+        {
+            triplets_.push_back(Triplet<Real>(dof_indices[i], dof_indices[j], Ke(i, j)));
+        }
+        
+        rhs_(dof_indices[i]) += Fe(i);
+    }
+}
+
+void DirectSolver::add(const DenseVector<Number> & Fe, const std::vector<dof_id_type> & dof_indices)
+{
+    for (unsigned int i = 0; i < dof_indices.size(); i++)
+    {
+        rhs_(dof_indices[i]) += Fe(i);
+    }
+}
+
+void DirectSolver::solve(LinearImplicitSystem & system)
+{
+    // Entries are summed up, explicit zeros are kept: the sparsity pattern only depends on the mesh connectivity.
+    matrix_.setFromTriplets(triplets_.begin(), triplets_.end());
+    matrix_.makeCompressed();
+    
+    const bool analyze = ( analyzed_nonzeros_ != matrix_.nonZeros() );
+    
+    if ( symmetric_ )
+    {
+        if ( analyze )
+        {
+            ldlt_.analyzePattern(matrix_);
+        }
+        
+        ldlt_.factorize(matrix_);
+        
+        if ( ldlt_.info() != Success )
+        {
+            throw std::runtime_error("DirectSolver::solve(): the LDLT factorization of system \"" + system.name() + "\" failed.");
+        }
+    }
+    else
+    {
+        if ( analyze )
+        {
+            lu_.analyzePattern(matrix_);
+        }
+        
+        lu_.factorize(matrix_);
+        
+        if ( lu_.info() != Success )
+        {
+            throw std::runtime_error("DirectSolver::solve(): the LU factorization of system \"" + system.name() + "\" failed.");
+        }
+    }
+    
+    analyzed_nonzeros_ = matrix_.nonZeros();
+    
+    copyToSystem(factorizedSolve(rhs_), system);
+}
+
+void DirectSolver::solve(LinearImplicitSystem & system, const DirectSolver & factorization)
+{
+    libmesh_assert_equal_to (factorization.rhs_.size(), rhs_.size());
+    
+    copyToSystem(factorization.factorizedSolve(rhs_), system);
+}
+
+VectorXr DirectSolver::factorizedSolve(const VectorXr & rhs) const
+{
+    if ( symmetric_ )
+    {
+        return ldlt_.solve(rhs);
+    }
+    else
+    {
+        return lu_.solve(rhs);
+    }
+}
+
+void DirectSolver::copyToSystem(const VectorXr & solution, LinearImplicitSystem & system) const
+{
+    for (Index i = 0; i < solution.size(); i++)
+    {
+        system.rhs->set(i, rhs_(i));
+        system.solution->set(i, solution(i));
+    }
+    
+    system.rhs->close();
+    system.solution->close();
+    
+    system.get_dof_map().enforce_constraints_exactly(system);
+    system.update();
+}
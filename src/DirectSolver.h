@@ -0,0 +1,112 @@
+/* C++ */
+
+/**
+ * @file   DirectSolver.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef DIRECTSOLVER_H
+#define DIRECTSOLVER_H
+
+#include "typedefs.h"
+
+/**
+ * @class DirectSolver
+ *
+ * @brief Classe che risolve un sistema lineare di libMesh con una fattorizzazione sparsa diretta di Eigen
+ *
+ * Le matrici elementari vengono raccolte come triplette durante l'assemblaggio.
+ * Poiché la connettività della mesh non cambia durante l'ottimizzazione, l'analisi simbolica
+ * (ordinamento e struttura dei fattori) viene calcolata una sola volta e
+ * ad ogni risoluzione viene rifatta soltanto la fattorizzazione numerica.
+ * Si usa @c SimplicialLDLT per le matrici simmetriche e @c SparseLU per le altre.
+ *
+ */
+class DirectSolver
+{
+    public:
+        /**
+         * @brief Costruttore
+         * @param[in] symmetric : vero se la matrice del sistema è simmetrica
+         *
+         */
+        DirectSolver(const bool & = true);
+        
+        /**
+         * @brief Prepara un nuovo assemblaggio, azzerando matrice e termine noto
+         * @param[in] system : sistema da assemblare
+         *
+         */
+        void begin(const System &);
+        
+        /**
+         * @brief Aggiunge il contributo di un elemento
+         * @param[in] Ke          : matrice elementare, già vincolata
+         * @param[in] Fe          : termine noto elementare, già vincolato
+         * @param[in] dof_indices : indici globali dei gradi di libertà dell'elemento
+         *
+         */
+        void add(const DenseMatrix<Number> &, const DenseVector<Number> &, const std::vector<dof_id_type> &);
+        
+        /**
+         * @brief Aggiunge il contributo di un elemento al solo termine noto
+         * @param[in] Fe          : termine noto elementare, già vincolato
+         * @param[in] dof_indices : indici globali dei gradi di libertà dell'elemento
+         *
+         */
+        void add(const DenseVector<Number> &, const std::vector<dof_id_type> &);
+        
+        /**
+         * @brief Fattorizza la matrice assemblata e risolve, scrivendo termine noto e soluzione nel sistema
+         * @param[in,out] system : sistema assemblato con begin() e add()
+         *
+         */
+        void solve(LinearImplicitSystem &);
+        
+        /**
+         * @brief Risolve con la fattorizzazione di un altro risolutore, senza assemblare la matrice
+         * @param[in,out] system        : sistema di cui è stato assemblato il solo termine noto
+         * @param[in]     factorization : risolutore che ha già fattorizzato la matrice, la stessa di @a system
+         *
+         */
+        void solve(LinearImplicitSystem &, const DirectSolver &);
+        
+    private:
+        /**
+         * @brief Risolve con la fattorizzazione corrente
+         * @param[in] rhs : termine noto
+         * @return la soluzione
+         *
+         */
+        VectorXr factorizedSolve(const VectorXr &) const;
+        
+        /**
+         * @brief Scrive termine noto e soluzione nel sistema, imponendo i vincoli
+         * @param[in]     solution : soluzione
+         * @param[in,out] system   : sistema di libMesh
+         *
+         */
+        void copyToSystem(const VectorXr &, LinearImplicitSystem &) const;
+        
+        bool symmetric_;                                /**< @brief vero se la matrice è simmetrica */
+        
+        std::vector<Triplet<Real> > triplets_;          /**< @brief contributi elementari alla matrice */
+        VectorXr rhs_;                                  /**< @brief termine noto */
+        SparseXr matrix_;                               /**< @brief matrice del sistema */
+        
+        SimplicialLDLT<SparseXr> ldlt_;                 /**< @brief fattorizzazione per le matrici simmetriche */
+        SparseLU<SparseXr> lu_;                         /**< @brief fattorizzazione per le matrici non simmetriche */
+        
+        Index analyzed_nonzeros_;                       /**< @brief numero di elementi non nulli della struttura analizzata, -1 se l'analisi non è stata fatta */
+};
+
+#endif /* DIRECTSOLVER_H */
@@ -0,0 +1,126 @@
+/* C++ */
+
+/**
+ * @file   ElasticityKernel.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef ELASTICITYKERNEL_H
+#define ELASTICITYKERNEL_H
+
+#include "typedefs.h"
+
+/**
+ * @class ElasticityKernel
+ *
+ * @brief Nucleo di assemblaggio della matrice elementare dell'elasticità lineare, specializzato a tempo di compilazione
+ * sul numero di gradi di libertà per componente dell'elemento e sulla dimensione
+ *
+ * La matrice elementare viene calcolata nella forma @f$ K_e = \sum_q w_q B_q^T D B_q @f$, dove @f$ D @f$ è la matrice
+ * costante di Lamé in notazione di Voigt e @f$ B_q @f$ la matrice delle deformazioni nel nodo di quadratura @f$ q @f$.
+ * Tutte le matrici hanno dimensioni fisse, così che il compilatore possa srotolare e vettorizzare i prodotti.
+ *
+ * Le colonne di @f$ B @f$ seguono l'ordine dei gradi di libertà di libMesh: prima tutte le @f$ u @f$, poi tutte le @f$ v @f$.
+ *
+ */
+template <unsigned int n_dofs, unsigned int dim>
+class ElasticityKernel;
+
+/**
+ * @brief Specializzazione bidimensionale (deformazione piana)
+ *
+ */
+template <unsigned int n_dofs>
+class ElasticityKernel<n_dofs, 2>
+{
+    public:
+        using MatrixB = Matrix<Real, 3, 2 * n_dofs>;               /**< @brief matrice delle deformazioni */
+        using MatrixD = Matrix<Real, 3, 3>;                        /**< @brief matrice di Lamé */
+        using MatrixK = Matrix<Real, 2 * n_dofs, 2 * n_dofs>;      /**< @brief matrice elementare */
+        
+        /**
+         * @brief Costruttore
+         * @param[in] lambda : coefficiente di Lamé @f$ \lambda @f$
+         * @param[in] mu     : coefficiente di Lamé @f$ \mu @f$
+         *
+         */
+        ElasticityKernel(const Real &, const Real &);
+        
+        /**
+         * @brief Somma alla matrice elementare il contributo di un nodo di quadratura
+         * @param[in]     dphi : gradienti delle funzioni di base di una componente
+         * @param[in]     qp   : indice del nodo di quadratura
+         * @param[in]     JxW  : peso del nodo di quadratura
+         * @param[in,out] K    : matrice elementare
+         *
+         */
+        void addQuadraturePoint(const std::vector<std::vector<RealGradient> > &, const unsigned int &, const Real &, MatrixK &);
+        
+        /**
+         * @brief Copia la matrice elementare in una matrice di libMesh
+         * @param[in]  K  : matrice elementare
+         * @param[out] Ke : matrice di libMesh, ridimensionata
+         *
+         */
+        static void copy(const MatrixK &, DenseMatrix<Number> &);
+        
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        
+    private:
+        MatrixD D_;     /**< @brief matrice di Lamé */
+        MatrixB B_;     /**< @brief matrice delle deformazioni, la cui struttura di zeri è fissa */
+};
+
+/**
+ * @brief Nucleo per i triangoli quadratici bidimensionali (Tri6)
+ *
+ */
+using ElasticityKernelTri6 = ElasticityKernel<6, 2>;
+
+template <unsigned int n_dofs>
+ElasticityKernel<n_dofs, 2>::ElasticityKernel(const Real & lambda, const Real & mu)
+    : B_(MatrixB::Zero())
+{
+    D_ << lambda + 2.0 * mu, lambda,            0.0,
+          lambda,            lambda + 2.0 * mu, 0.0,
+          0.0,               0.0,               mu;
+}
+
+template <unsigned int n_dofs>
+void ElasticityKernel<n_dofs, 2>::addQuadraturePoint(const std::vector<std::vector<RealGradient> > & dphi, const unsigned int & qp, const Real & JxW, MatrixK & K)
+{
+    for (unsigned int i = 0; i < n_dofs; i++)
+    {
+        B_(0, i)          = dphi[i][qp](0);
+        B_(1, n_dofs + i) = dphi[i][qp](1);
+        B_(2, i)          = dphi[i][qp](1);
+        B_(2, n_dofs + i) = dphi[i][qp](0);
+    }
+    
+    K.noalias() += JxW * (B_.transpose() * (D_ * B_));
+}
+
+template <unsigned int n_dofs>
+void ElasticityKernel<n_dofs, 2>::copy(const MatrixK & K, DenseMatrix<Number> & Ke)
+{
+    Ke.resize(2 * n_dofs, 2 * n_dofs);
+    
+    for (unsigned int i = 0; i < 2 * n_dofs; i++)
+    {
+        for (unsigned int j = 0; j < 2 * n_dofs; j++)
+        {
+            Ke(i, j) = K(i, j);
+        }
+    }
+}
+
+#endif /* ELASTICITYKERNEL_H */
@@ -0,0 +1,222 @@
+#include "ElasticityOperator.h"
+
+ElasticityOperator::ElasticityOperator(const Parallel::Communicator & comm, const Real & lambda, const Real & mu)
+    : ShellMatrix<Number>(comm), lambda_(lambda), mu_(mu), n_dofs_(0) {}
+
+void ElasticityOperator::update(const System & system)
+{
+    const MeshBase & mesh = system.get_mesh();
+    const unsigned int dim = mesh.mesh_dimension();
+    
+    const unsigned int u_var = system.variable_number ("u");
+    const unsigned int v_var = system.variable_number ("v");
+    
+    const DofMap & dof_map = system.get_dof_map();
+    
+    // DOF numbering and constraints only depend on the connectivity.
+    const bool topology = ( n_dofs_ != system.n_dofs() );
+    
+    if ( topology )
+    {
+        n_dofs_ = system.n_dofs();
+        
+        constrained_.assign(n_dofs_, false);
+        
+        for (dof_id_type i = 0; i < n_dofs_; i++)
+        {
+            constrained_[i] = dof_map.is_constrained_dof(i);
+        }
+        
+        dof_indices_u_.clear();
+        dof_indices_v_.clear();
+        
+        // The products only read the local and ghost entries of their argument, as System::update() does.
+        send_list_.assign(dof_map.get_send_list().begin(), dof_map.get_send_list().end());
+        
+        ghosted_.reset(NumericVector<Number>::build(comm()).release());
+        ghosted_->init(n_dofs_, system.n_local_dofs(), send_list_, false, GHOSTED);
+    }
+    
+    FEType fe_type = system.variable_type(u_var);
+    AutoPtr<FEBase> fe (FEBase::build(dim, fe_type));
+    QGauss qrule (dim, fe_type.default_quadrature_order());
+    fe->attach_quadrature_rule (&qrule);
+    
+    const std::vector<Real>& JxW = fe->get_JxW();
+    const std::vector<std::vector<RealGradient> >& dphi = fe->get_dphi();
+    
+    JxW_.clear();
+    dphi_x_.clear();
+    dphi_y_.clear();
+    
+    MeshBase::const_element_iterator       el     = mesh.active_local_elements_begin();
+    const MeshBase::const_element_iterator end_el = mesh.active_local_elements_end();
+    
+    for ( ; el != end_el; ++el)
+    {
+        const Elem* elem = *el;
+        
+        if ( topology )
+        {
+            dof_indices_u_.push_back(std::vector<dof_id_type>());
+            dof_indices_v_.push_back(std::vector<dof_id_type>());
+            
+            dof_map.dof_indices (elem, dof_indices_u_.back(), u_var);
+            dof_map.dof_indices (elem, dof_indices_v_.back(), v_var);
+        }
+        
+        fe->reinit (elem);
+        
+        const unsigned int n_qp = qrule.n_points();
+        const unsigned int n_u_dofs = dphi.size();
+        
+        JxW_.push_back(VectorXr(n_qp));
+        dphi_x_.push_back(MatrixXr(n_qp, n_u_dofs));
+        dphi_y_.push_back(MatrixXr(n_qp, n_u_dofs));
+        
+        for (unsigned int qp = 0; qp < n_qp; qp++)
+        {
+            JxW_.back()(qp) = JxW[qp];
+            
+            for (unsigned int i = 0; i < n_u_dofs; i++)
+            {
+                dphi_x_.back()(qp, i) = dphi[i][qp](0);
+                dphi_y_.back()(qp, i) = dphi[i][qp](1);
+            }
+        }
+    }
+}
+
+numeric_index_type ElasticityOperator::m() const
+{
+    return n_dofs_;
+}
+
+numeric_index_type ElasticityOperator::n() const
+{
+    return n_dofs_;
+}
+
+void ElasticityOperator::vector_mult(NumericVector<Number> & dest, const NumericVector<Number> & arg) const
+{
+    arg.localize(*ghosted_, send_list_);
+    
+    const NumericVector<Number> & x = *ghosted_;
+    
+    dest.zero();
+    
+    DenseVector<Number> Fu;
+    DenseVector<Number> Fv;
+    
+    for (std::size_t e = 0; e < JxW_.size(); e++)
+    {
+        const std::vector<dof_id_type> & dof_indices_u = dof_indices_u_[e];
+        const std::vector<dof_id_type> & dof_indices_v = dof_indices_v_[e];
+        
+        const MatrixXr & dphi_x = dphi_x_[e];
+        const MatrixXr & dphi_y = dphi_y_[e];
+        
+        // Local displacement, with the constrained values removed.
+        VectorXr u(dof_indices_u.size());
+        VectorXr v(dof_indices_v.size());
+        
+        for (unsigned int i = 0; i < dof_indices_u.size(); i++)
+        {
+            u(i) = constrained_[dof_indices_u[i]] ? 0.0 : x(dof_indices_u[i]);
+            v(i) = constrained_[dof_indices_v[i]] ? 0.0 : x(dof_indices_v[i]);
+        }
+        
+        // Strains and weighted stresses at the quadrature points.
+        const VectorXr exx = dphi_x * u;
+        const VectorXr eyy = dphi_y * v;
+        const VectorXr gxy = dphi_y * u + dphi_x * v;
+        
+        const VectorXr sxx = JxW_[e].cwiseProduct((lambda_ + 2.0 * mu_) * exx + lambda_ * eyy);
+        const VectorXr syy = JxW_[e].cwiseProduct(lambda_ * exx + (lambda_ + 2.0 * mu_) * eyy);
+        const VectorXr sxy = JxW_[e].cwiseProduct(mu_ * gxy);
+        
+        const VectorXr fu = dphi_x.transpose() * sxx + dphi_y.transpose() * sxy;
+        const VectorXr fv = dphi_y.transpose() * syy + dphi_x.transpose() * sxy;
+        
+        Fu.resize(dof_indices_u.size());
+        Fv.resize(dof_indices_v.size());
+        
+        for (unsigned int i = 0; i < dof_indices_u.size(); i++)
+        {
+            Fu(i) = fu(i);
+            Fv(i) = fv(i);
+        }
+        
+        dest.add_vector(Fu, dof_indices_u);
+        dest.add_vector(Fv, dof_indices_v);
+    }
+    
+    dest.close();
+    
+    applyConstraints(dest, arg);
+}
+
+void ElasticityOperator::vector_mult_add(NumericVector<Number> & dest, const NumericVector<Number> & arg) const
+{
+    AutoPtr<NumericVector<Number> > product = dest.zero_clone();
+    
+    vector_mult(*product, arg);
+    
+    dest.add(*product);
+}
+
+void ElasticityOperator::get_diagonal(NumericVector<Number> & dest) const
+{
+    dest.zero();
+    
+    DenseVector<Number> Du;
+    DenseVector<Number> Dv;
+    
+    for (std::size_t e = 0; e < JxW_.size(); e++)
+    {
+        const VectorXr & JxW = JxW_[e];
+        
+        const MatrixXr dphi_x2 = dphi_x_[e].cwiseAbs2();
+        const MatrixXr dphi_y2 = dphi_y_[e].cwiseAbs2();
+        
+        const VectorXr du = (lambda_ + 2.0 * mu_) * dphi_x2.transpose() * JxW + mu_ * dphi_y2.transpose() * JxW;
+        const VectorXr dv = (lambda_ + 2.0 * mu_) * dphi_y2.transpose() * JxW + mu_ * dphi_x2.transpose() * JxW;
+        
+        Du.resize(du.size());
+        Dv.resize(dv.size());
+        
+        for (Index i = 0; i < du.size(); i++)
+        {
+            Du(i) = du(i);
+            Dv(i) = dv(i);
+        }
+        
+        dest.add_vector(Du, dof_indices_u_[e]);
+        dest.add_vector(Dv, dof_indices_v_[e]);
+    }
+    
+    dest.close();
+    
+    for (numeric_index_type i = dest.first_local_index(); i < dest.last_local_index(); i++)
+    {
+        if ( constrained_[i] )
+        {
+            dest.set(i, 1.0);
+        }
+    }
+    
+    dest.close();
+}
+
+void ElasticityOperator::applyConstraints(NumericVector<Number> & dest, const NumericVector<Number> & arg) const
+{
+    for (numeric_index_type i = dest.first_local_index(); i < dest.last_local_index(); i++)
+    {
+        if ( constrained_[i] )
+        {
+            dest.set(i, arg(i));
+        }
+    }
+    
+    dest.close();
+}
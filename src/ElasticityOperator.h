@@ -0,0 +1,105 @@
+/* C++ */
+
+/**
+ * @file   ElasticityOperator.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef ELASTICITYOPERATOR_H
+#define ELASTICITYOPERATOR_H
+
+#include "typedefs.h"
+
+/**
+ * @class ElasticityOperator
+ *
+ * @brief Operatore dell'elasticità lineare applicato elemento per elemento, senza assemblare la matrice di rigidezza
+ *
+ * Per ogni elemento vengono memorizzati i pesi di quadratura @f$ JxW @f$ e i gradienti delle funzioni di base
+ * nei nodi di quadratura; il prodotto matrice-vettore calcola deformazioni e sforzi nei nodi di quadratura
+ * e li proietta sui gradi di libertà dell'elemento.
+ * Gradi di libertà e vincoli dipendono solo dalla connettività e vengono calcolati una sola volta;
+ * dopo una deformazione della mesh va aggiornata soltanto la geometria con update().
+ * L'argomento del prodotto viene letto tramite una copia con i soli valori locali e fantasma,
+ * allocata una volta sola insieme ai gradi di libertà.
+ *
+ * I vincoli sono di Dirichlet omogenei: le righe e le colonne dei gradi di libertà vincolati
+ * sono sostituite dall'identità, così che la diagonale usata dal precondizionatore di Jacobi resti positiva.
+ *
+ */
+class ElasticityOperator : public ShellMatrix<Number>
+{
+    public:
+        /**
+         * @brief Costruttore
+         * @param[in] comm   : comunicatore
+         * @param[in] lambda : coefficiente di Lamé @f$ \lambda @f$
+         * @param[in] mu     : coefficiente di Lamé @f$ \mu @f$
+         *
+         */
+        ElasticityOperator(const Parallel::Communicator &, const Real &, const Real &);
+        
+        /**
+         * @brief Distruttore (defaulted)
+         *
+         */
+        virtual ~ElasticityOperator() = default;
+        
+        /**
+         * @brief Aggiorna i fattori geometrici sulla mesh corrente
+         * @param[in] system : sistema dell'elasticità, con le variabili "u" e "v"
+         *
+         */
+        void update(const System &);
+        
+        /** @copydoc ShellMatrix::m() */
+        virtual numeric_index_type m() const;
+        
+        /** @copydoc ShellMatrix::n() */
+        virtual numeric_index_type n() const;
+        
+        /** @copydoc ShellMatrix::vector_mult() */
+        virtual void vector_mult(NumericVector<Number> &, const NumericVector<Number> &) const;
+        
+        /** @copydoc ShellMatrix::vector_mult_add() */
+        virtual void vector_mult_add(NumericVector<Number> &, const NumericVector<Number> &) const;
+        
+        /** @copydoc ShellMatrix::get_diagonal() */
+        virtual void get_diagonal(NumericVector<Number> &) const;
+        
+    private:
+        /**
+         * @brief Pone uguali all'argomento le componenti vincolate del risultato
+         * @param[in,out] dest : risultato, chiuso
+         * @param[in]     arg  : argomento
+         *
+         */
+        void applyConstraints(NumericVector<Number> &, const NumericVector<Number> &) const;
+        
+        Real lambda_;                                           /**< @brief coefficiente di Lamé @f$ \lambda @f$ */
+        Real mu_;                                               /**< @brief coefficiente di Lamé @f$ \mu @f$ */
+        
+        dof_id_type n_dofs_;                                    /**< @brief numero di gradi di libertà del sistema */
+        std::vector<bool> constrained_;                         /**< @brief per ogni grado di libertà, vero se è vincolato */
+        
+        std::vector<numeric_index_type> send_list_;             /**< @brief gradi di libertà fantasma letti dagli elementi locali */
+        std::shared_ptr<NumericVector<Number> > ghosted_;       /**< @brief copia dell'argomento del prodotto con i valori locali e fantasma */
+        
+        std::vector<std::vector<dof_id_type> > dof_indices_u_;  /**< @brief per ogni elemento, gradi di libertà della componente @f$ x @f$ */
+        std::vector<std::vector<dof_id_type> > dof_indices_v_;  /**< @brief per ogni elemento, gradi di libertà della componente @f$ y @f$ */
+        
+        std::vector<VectorXr> JxW_;                             /**< @brief per ogni elemento, pesi dei nodi di quadratura */
+        std::vector<MatrixXr> dphi_x_;                          /**< @brief per ogni elemento, derivate in @f$ x @f$ delle funzioni di base (nodi di quadratura per righe) */
+        std::vector<MatrixXr> dphi_y_;                          /**< @brief per ogni elemento, derivate in @f$ y @f$ delle funzioni di base (nodi di quadratura per righe) */
+};
+
+#endif /* ELASTICITYOPERATOR_H */
@@ -1,8 +1,19 @@
 #include "FFD.h"
 
-FFD::FFD(const Problem & problem, const std::string & directory, const Real & step, const Index & maxIterationsNo, const Real & tolerance, const bool & volume_constraint, const std::pair<Point, Point> & boundingBox, const std::pair<Index, Index> & sub, const Real & armijoSlope)
+FFD::FFD(const Problem & problem, const std::string & directory, const Real & step, const Index & maxIterationsNo, const Real & tolerance, const bool & volume_constraint, const std::pair<Point, Point> & boundingBox, const std::pair<Index, Index> & sub, const Real & armijoSlope, const Index & degree)
     : ShapeOptimization(problem, directory, step, maxIterationsNo, tolerance, volume_constraint, armijoSlope), reference_mesh_(*problem_.get_mesh()), boundingBox_(boundingBox), sub_(sub), firstTime_(true)
 {
+    if ( degree == 0 )
+    {
+        basis_x_ = std::make_shared<BernsteinBasis>(sub_.first);
+        basis_y_ = std::make_shared<BernsteinBasis>(sub_.second);
+    }
+    else
+    {
+        basis_x_ = std::make_shared<BSplineBasis>(sub_.first, degree);
+        basis_y_ = std::make_shared<BSplineBasis>(sub_.second, degree);
+    }
+    
     // Assemble the control points grid.
     CP_grid_.resize(sub_.second + 1, sub_.first + 1);
     
@@ -30,111 +41,76 @@ FFD::FFD(const Problem & problem, const std::string & directory, const Real & st
 
 void FFD::computePerturbation(EquationSystems & perturbation, EquationSystems & stateAdj)
 {
-    const unsigned int dim = reference_mesh_.mesh_dimension();
-    LinearImplicitSystem & system = stateAdj.get_system<LinearImplicitSystem>(problem_.get_name());
+    const BoundaryQuadratureCache & cache = problem_.get_boundary_cache(stateAdj.get_mesh());
+    const std::vector<BoundaryQuadratureCache::Side> & sides = cache.get_sides();
     
-    const DofMap& dof_map = system.get_dof_map();
-    
-    FEType fe_type = dof_map.variable_type(0);
-    AutoPtr<FEBase> fe (FEBase::build(dim, fe_type));
-    QGauss qrule (dim, fe_type.default_quadrature_order());
-    fe->attach_quadrature_rule (&qrule);
-    
-    AutoPtr<FEBase> fe_face (FEBase::build(dim, fe_type));
-    QGauss qface(dim - 1, fe_type.default_quadrature_order());
-    fe_face->attach_quadrature_rule (&qface);
-    
-    Index quadNodesNo = qface.n_points();
-    Index count = 0;
+    const unsigned int quadNodesNo = cache.n_points();
     
     if ( firstTime_ )
     {
         firstTime_ = false;
         
-        Mesh::const_element_iterator       ref_el     = reference_mesh_.active_local_elements_begin();
-        const Mesh::const_element_iterator ref_end_el = reference_mesh_.active_local_elements_end();
+        // Nodi di quadratura nella mesh di riferimento, nello stesso ordine dei lati di bordo della mesh corrente.
+        BoundaryQuadratureCache reference_cache(cache.get_fe_type(), cache.get_quadrature_order());
+        reference_cache.reinit(reference_mesh_);
+        
+        const std::vector<BoundaryQuadratureCache::Side> & reference_sides = reference_cache.get_sides();
         
-        // Conta numero di lati di bordo e numero di nodi di quadratura per ogni lato.
-        Index edgesNo = 0;
+        reference_nodes_.resize( reference_sides.size() * quadNodesNo );
         
-        for ( ; ref_el != ref_end_el; ++ref_el)
+        for (std::size_t count = 0; count < reference_sides.size(); ++count)
         {
-            const Elem * elem = *ref_el;
-            
-            for (unsigned int side = 0; side < elem->n_sides(); side++)
+            for (unsigned int qp = 0; qp < quadNodesNo; qp++)
             {
-                if (elem->neighbor(side) == NULL)
-                {
-                    ++edgesNo;
-                }
+                reference_nodes_(count * quadNodesNo + qp) = reference_sides[count].xyz[qp];
             }
         }
         
-        // Nodi di quadratura nella mesh di riferimento.
-        reference_nodes_.resize( edgesNo * quadNodesNo );
+        // The reference nodes never change: their basis values are computed once,
+        // with the column l * (K + 1) + k for the control point k, l.
+        std::vector<Triplet<Real> > triplets;
         
-        ref_el = reference_mesh_.active_local_elements_begin(); // Resetta iteratore.
+        for (Index n = 0; n < reference_nodes_.size(); ++n)
+        {
+            addBasisRow( psi( reference_nodes_(n) ), n, triplets );
+        }
         
-        for ( ; ref_el != ref_end_el; ++ref_el)
+        reference_basis_.resize(reference_nodes_.size(), gradJ_.cols() * gradJ_.rows());
+        reference_basis_.setFromTriplets(triplets.begin(), triplets.end());
+    }
+    
+    // Shape gradient times the scaled normal at the boundary quadrature nodes, one column per direction.
+    MatrixXr weights = MatrixXr::Zero(reference_basis_.rows(), mesh_->mesh_dimension());
+    
+    std::vector<Real> gradient;
+    
+    for (std::size_t count = 0; count < sides.size(); ++count)
+    {
+        const BoundaryQuadratureCache::Side & side = sides[count];
+        
+        problem_.computeGradient(stateAdj, side, gradient);
+        
+        for (unsigned int qp = 0; qp < quadNodesNo; qp++)
         {
-            const Elem * elem = *ref_el;
+            Real g = gradient[qp] + actual_lagrange_;
             
-            for (unsigned int side = 0; side < elem->n_sides(); side++)
+            for ( Index i = 0; i < mesh_->mesh_dimension(); ++i )
             {
-                if (elem->neighbor(side) == NULL)
-                {
-                    const std::vector<Point> & qface_point = fe_face->get_xyz();
-                    fe_face->reinit(elem, side);
-                    
-                    for (unsigned int qp = 0; qp < qface.n_points(); qp++)
-                    {
-                        reference_nodes_(count * quadNodesNo + qp) = qface_point[qp];
-                    }
-                    
-                    ++count;
-                }
+                weights(count * quadNodesNo + qp, i) = g * side.JxW[qp] * (boundingBox_.second(i) - boundingBox_.first(i)) * side.normals[qp](i);
             }
         }
     }
     
     // Gradiente del funzionale costo.
-    Mesh::const_element_iterator       el     = mesh_->active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh_->active_local_elements_end();
-    
-    count = 0;
+    const MatrixXr gradient = reference_basis_.transpose() * weights;
     
-    for ( ; el != end_el; ++el)
+    for ( Index k = 0; k < gradJ_.cols(); ++k )
     {
-        const Elem * elem = *el;
-        
-        for (unsigned int side = 0; side < elem->n_sides(); side++)
+        for ( Index l = 0; l < gradJ_.rows(); ++l )
         {
-            if (elem->neighbor(side) == NULL)
+            for ( Index i = 0; i < mesh_->mesh_dimension(); ++i )
             {
-                const std::vector<Real> & JxW_face = fe_face->get_JxW();
-                const std::vector<Point> & face_normals = fe_face->get_normals();
-                const std::vector<Point> & qface_point = fe_face->get_xyz();
-                fe_face->reinit(elem, side);
-                
-                for (unsigned int qp = 0; qp < qface.n_points(); qp++)
-                {
-                    Real g = problem_.computeGradient(stateAdj, qface_point[qp]) + actual_lagrange_;
-                    
-                    for ( Index k = 0; k < gradJ_.cols(); ++k )
-                    {
-                        for ( Index l = 0; l < gradJ_.rows(); ++l )
-                        {
-                            Real b = basisFunction( psi( reference_nodes_(count * quadNodesNo + qp) ), k, l);
-                            
-                            for ( Index i = 0; i < mesh_->mesh_dimension(); ++i )
-                            {
-                                gradJ_(gradJ_.rows() - l - 1, k)(i) += b * g * JxW_face[qp] * (boundingBox_.second(i) - boundingBox_.first(i)) * face_normals[qp](i);
-                            }
-                        }
-                    }
-                }
-                
-                ++count;
+                gradJ_(gradJ_.rows() - l - 1, k)(i) += gradient(l * gradJ_.cols() + k, i);
             }
         }
     }
@@ -156,69 +132,99 @@ void FFD::applyPerturbation(const EquationSystems & perturbation)
     // Fix control points.
     problem_.fixCP(CP_grid_, mu_);
     
-    Mesh::const_element_iterator       ref_el     = reference_mesh_.active_local_elements_begin();
-    const Mesh::const_element_iterator ref_end_el = reference_mesh_.active_local_elements_end();
-    
-    Mesh::const_element_iterator       el     = mesh_->active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh_->active_local_elements_end();
+    if ( reference_vertices_.rows() == 0 )
+    {
+        computeVertexWeights();
+    }
     
-    std::vector<bool> hasMoved(mesh_->n_nodes(), false);
+    // Control point displacements, with the row l * (K + 1) + k for the control point k, l.
+    MatrixXr displacements(mu_.rows() * mu_.cols(), mesh_->mesh_dimension());
     
-    for ( ; ref_el != ref_end_el, el != end_el ; ++ref_el, ++el )
+    for ( Index k = 0; k < mu_.cols(); ++k )
     {
-        const Elem * ref_elem = *ref_el;
-        const Elem * elem     = *el;
-        
-        Node * ref_node;
-        Node * node;
-        
-        Index subPerSide = elem->n_nodes() / 3 - 1;
-        
-        for ( Index n = 0; n < elem->n_vertices(); ++n ) // loop over vertices
+        for ( Index l = 0; l < mu_.rows(); ++l )
         {
-            ref_node = ref_elem->get_node(n);
-            node     = elem->get_node(n);
-            
-            if ( !hasMoved[node->id()] && problem_.toBeMoved(*node) )
+            for ( Index i = 0; i < mesh_->mesh_dimension(); ++i )
             {
-                (*node) = deform( (*ref_node) );
-                
-                hasMoved[node->id()] = true;
+                displacements(l * mu_.cols() + k, i) = (boundingBox_.second(i) - boundingBox_.first(i)) * mu_(mu_.rows() - l - 1, k)(i);
             }
         }
+    }
+    
+    // All the vertices are deformed at once.
+    MatrixXr deformed = reference_vertices_;
+    deformed.noalias() += vertex_weights_ * displacements;
+    
+    deformer_.setVertices(*mesh_, deformed);
+}
+
+void FFD::computeVertexWeights()
+{
+    // The reference mesh is a copy of the current one: the vertices have the same indices.
+    const std::vector<dof_id_type> & vertices = deformer_.get_vertices();
+    
+    reference_vertices_.resize(vertices.size(), mesh_->mesh_dimension());
+    
+    std::vector<Triplet<Real> > triplets;
+    
+    for ( std::size_t v = 0; v < vertices.size(); ++v )
+    {
+        const Point & point = reference_mesh_.point(vertices[v]);
+        
+        addBasisRow(psi(point), v, triplets);
         
-        for ( Index n = elem->n_vertices(); n < elem->n_nodes(); ++n ) // loop over non-vertices
+        for ( Index i = 0; i < mesh_->mesh_dimension(); ++i )
         {
-            node = elem->get_node(n);
-            
-            if ( !hasMoved[node->id()] && problem_.toBeMoved(*node) )
-            {
-                Index idA = (n - 3) / subPerSide;              // ID del vertice precedente.
-                Index idB = ((n - 3 + 1) / subPerSide) % 3;    // ID del vertice successivo.
-                
-                Point * node1 = elem->get_node(idA);
-                Point * node2 = elem->get_node(idB);
-                
-                for ( Index c = 0; c < mesh_->mesh_dimension(); ++c )
-                {
-                    (*node)(c) = 1.0 / (subPerSide + 1) * ((n - 3) - subPerSide * idA + 1) * ( (*node1)(c) + (*node2)(c) ); // 1/(#nodi per lato+1) * (che ordinamento ha il nodo nel lato) * (incremento)
-                }
-                
-                hasMoved[node->id()] = true;
-            }
+            reference_vertices_(v, i) = point(i);
         }
     }
     
-    //mesh_->write("DeformedMesh.vtu");
+    vertex_weights_.resize(vertices.size(), CP_grid_.rows() * CP_grid_.cols());
+    vertex_weights_.setFromTriplets(triplets.begin(), triplets.end());
+}
+
+void FFD::addBasisRow(const Point & ref_point, const Index & row, std::vector<Triplet<Real> > & triplets) const
+{
+    Index first_x, first_y;
+    VectorXr values_x, values_y;
+    
+    basis_x_->evaluateNonZero(ref_point(0), first_x, values_x);
+    basis_y_->evaluateNonZero(ref_point(1), first_y, values_y);
+    
+    // Only the control points in the support of the point are stored.
+    for ( Index l = 0; l < values_y.size(); ++l )
+    {
+        for ( Index k = 0; k < values_x.size(); ++k )
+        {
+            triplets.push_back(Triplet<Real>(row, (first_y + l) * CP_grid_.cols() + first_x + k, values_x(k) * values_y(l)));
+        }
+    }
+}
+
+void FFD::saveParameters()
+{
+    mu_old_ = mu_;
+}
+
+void FFD::restoreParameters()
+{
+    mu_ = mu_old_;
 }
 
 Real FFD::basisFunction(const Point & point, const Index & k, const Index & l) const
 {
-    Index K = CP_grid_.cols() - 1;
-    Index L = CP_grid_.rows() - 1;
+    return basis_x_->value(point(0), k) * basis_y_->value(point(1), l);
+}
+
+void FFD::evaluateBasis(const Point & point, MatrixXr & values) const
+{
+    VectorXr values_x;
+    VectorXr values_y;
+    
+    basis_x_->evaluate(point(0), values_x);
+    basis_y_->evaluate(point(1), values_y);
     
-    return ( binomial_coefficient<Real>(K, k) * std::pow(1 - point(0), K - k) * std::pow(point(0), k) *
-             binomial_coefficient<Real>(L, l) * std::pow(1 - point(1), L - l) * std::pow(point(1), l) );
+    values.noalias() = values_x * values_y.transpose();
 }
 
 Point FFD::psi(const Point & point) const
@@ -252,7 +258,8 @@ Point FFD::deform(const Point & point) const
 {
     Point deformed_point(point);
     
-    Point psiPoint = psi(point);
+    MatrixXr basis;
+    evaluateBasis(psi(point), basis);
     
     for ( Index k = 0; k < CP_grid_.cols(); ++k )
     {
@@ -260,7 +267,7 @@ Point FFD::deform(const Point & point) const
         {
             for ( Index i = 0; i < mesh_->mesh_dimension(); ++i )
             {
-                deformed_point(i) += basisFunction(psiPoint, k, l) * (boundingBox_.second(i) - boundingBox_.first(i)) * mu_(mu_.rows() - l - 1, k)(i);
+                deformed_point(i) += basis(k, l) * (boundingBox_.second(i) - boundingBox_.first(i)) * mu_(mu_.rows() - l - 1, k)(i);
             }
         }
     }
@@ -17,6 +17,8 @@
 #ifndef FFD_H
 #define FFD_H
 
+#include "BernsteinBasis.h"
+#include "BSplineBasis.h"
 #include "ShapeOptimization.h"
 
 /**
@@ -24,6 +26,10 @@
  *
  * @brief Classe che eredita dalla classe ShapeOptimization, utilizza il metodo della Free Form Deformation utilizzando come funzioni di base le B-Spline
  *
+ * Con grado nullo le funzioni di base sono i polinomi di Bernstein di grado @f$ K @f$ e @f$ L @f$, che hanno supporto globale.
+ * Con grado @f$ p > 0 @f$ sono B-spline clamped di grado @f$ p @f$ sulle stesse suddivisioni: ogni punto dipende solo da
+ * @f$ (p + 1)^2 @f$ control point e le matrici delle funzioni di base nei nodi della mesh sono sparse.
+ *
  */
 class FFD : public ShapeOptimization
 {
@@ -39,9 +45,10 @@ class FFD : public ShapeOptimization
          * @param[in] boundingBox       : Punti a nord est e a sud ovest indicanti il range della bounding box
          * @param[in] sub               : Coppia contenente il numero di intervalli in cui suddividere la base e l'altezza della bounding box
          * @param[in] armijoSlope       : Coefficiente di rilassamento per la regola di Armijo.
+         * @param[in] degree            : Grado delle B-spline, zero per i polinomi di Bernstein
          *
          */
-        FFD(const Problem &, const std::string &, const Real &, const Index &, const Real &, const bool &, const std::pair<Point, Point> &, const std::pair<Index, Index> &, const Real & = 1.0e-4);
+        FFD(const Problem &, const std::string &, const Real &, const Index &, const Real &, const bool &, const std::pair<Point, Point> &, const std::pair<Index, Index> &, const Real & = 1.0e-4, const Index & = 0);
         
         /**
          * @brief Calcola la deformazione della mesh
@@ -58,6 +65,12 @@ class FFD : public ShapeOptimization
          */
         virtual void applyPerturbation(const EquationSystems &);
         
+        /** @copydoc ShapeOptimization::saveParameters() */
+        virtual void saveParameters();
+        
+        /** @copydoc ShapeOptimization::restoreParameters() */
+        virtual void restoreParameters();
+        
         /**
          * @brief calcola la funzione di base k, l per il punto x
          * @param[in] point : punto in cui calcolare la funzione di base
@@ -68,6 +81,16 @@ class FFD : public ShapeOptimization
          */
         virtual Real basisFunction(const Point &, const Index &, const Index &) const;
         
+        /**
+         * @brief calcola tutte le funzioni di base nel punto x
+         * @param[in]  point  : punto nel quadrato unitario in cui calcolare le funzioni di base
+         * @param[out] values : matrice @f$ (K + 1) \times (L + 1) @f$ contenente in posizione @f$ (k, \ell) @f$ il valore della funzione di base @f$ k, \ell @f$
+         *
+         * Le funzioni univariate vengono valutate una sola volta per direzione e combinate con un prodotto tensoriale.
+         *
+         */
+        virtual void evaluateBasis(const Point &, MatrixXr &) const;
+        
         /**
          * @brief mappa la scatola nel quadrato unitario
          * @param[in] point : punto nella scatola da trasformare
@@ -93,15 +116,41 @@ class FFD : public ShapeOptimization
         Point deform(const Point &) const;
         
     protected:
+        /**
+         * @brief Calcola una volta per tutte i pesi delle funzioni di base nei vertici della mesh di riferimento
+         *
+         * La deformazione dei vertici diventa il prodotto @f$ X_{ref} + W M @f$, dove la riga di @f$ W @f$ contiene
+         * le funzioni di base nel vertice e @f$ M @f$ gli spostamenti dei control point scalati con la scatola.
+         *
+         */
+        void computeVertexWeights();
+        
+        /**
+         * @brief Aggiunge le funzioni di base non nulle in un punto come riga di una matrice sparsa
+         * @param[in]     ref_point : punto nel quadrato unitario
+         * @param[in]     row       : riga della matrice
+         * @param[in,out] triplets  : triplette della matrice, con la colonna @f$ \ell (K + 1) + k @f$ per il control point @f$ k, \ell @f$
+         *
+         */
+        void addBasisRow(const Point &, const Index &, std::vector<Triplet<Real> > &) const;
+        
         Mesh reference_mesh_;                       /**< @brief mesh di riferimento */
         
         VectorXp reference_nodes_;                  /**< @brief vettore contenente i nodi del bordo nella mesh di riferimento */
+        SparseXr reference_basis_;                  /**< @brief matrice @f$ B @f$ dei valori delle funzioni di base nei nodi del bordo di riferimento, con una riga per nodo e una colonna per control point */
+        
+        SparseXr vertex_weights_;                   /**< @brief matrice @f$ W @f$ delle funzioni di base nei vertici di riferimento, con una riga per vertice di MeshDeformer::get_vertices() e una colonna per control point */
+        MatrixXr reference_vertices_;               /**< @brief coordinate dei vertici nella mesh di riferimento, una riga per vertice */
         std::pair<Point, Point> boundingBox_;       /**< @brief coppia contenente i punti nord est e sud ovest che definiscono la scatola */
         std::pair<Index, Index> sub_;               /**< @brief coppia di numeri indicanti il numero di suddivisioni in orizzontale e in verticale */
         MatrixXp CP_grid_;                          /**< @brief matrice contenente i control point */
         MatrixXp mu_;                               /**< @brief matrice contenente gli spostamenti desiderati per i control point */
+        MatrixXp mu_old_;                           /**< @brief valore di @a mu_ prima del passo di prova, ripristinato se la regola di Armijo lo rifiuta */
         MatrixXp gradJ_;                            /**< @brief matrice contenente il gradiente in funzione dei control point */
         
+        std::shared_ptr<UnivariateBasis> basis_x_;  /**< @brief funzioni di base nella direzione orizzontale */
+        std::shared_ptr<UnivariateBasis> basis_y_;  /**< @brief funzioni di base nella direzione verticale */
+        
         bool firstTime_;                            /**< @brief booleano: vero se è la prima volta che calcola la perturbazione dell'identità */
 };
 
@@ -1,7 +1,7 @@
 #include "FFD_LS.h"
 
-FFD_LS::FFD_LS(const Problem & problem, const std::string & directory, const Real & step, const Index & maxIterationsNo, const Real & tolerance, const bool & volume_constraint, const std::pair<Point, Point> & boundingBox, const std::pair<Index, Index> & sub, const Real & beta, const Real & armijoSlope)
-    : FFD(problem, directory, step, maxIterationsNo, tolerance, volume_constraint, boundingBox, sub, armijoSlope), beta_(beta)
+FFD_LS::FFD_LS(const Problem & problem, const std::string & directory, const Real & step, const Index & maxIterationsNo, const Real & tolerance, const bool & volume_constraint, const std::pair<Point, Point> & boundingBox, const std::pair<Index, Index> & sub, const Real & beta, const Real & armijoSlope, const Index & degree)
+    : FFD(problem, directory, step, maxIterationsNo, tolerance, volume_constraint, boundingBox, sub, armijoSlope, degree), beta_(beta)
 {
     //Scanning the border nodes
     Mesh::const_element_iterator       ref_el     = reference_mesh_.active_local_elements_begin();
@@ -16,32 +16,130 @@ FFD_LS::FFD_LS(const Problem & problem, const std::string & directory, const Rea
             if (elem->neighbor(side) == NULL)
             {
                 border_ref_.push_back(*(elem->get_node(side)));
+                border_nodes_.push_back(elem->get_node(side)->id());
+                
+                // The position of the node in the reference element does not change with the deformation.
+                border_elems_.push_back(elem->id());
+                border_reference_points_.push_back(FEInterface::inverse_map(elem->dim(), FEType(), elem, *(elem->get_node(side))));
             }
         }
     }
     
+    // Boundary edges as pairs of positions in border_nodes_: the normals are then summed with a single sweep.
+    std::map<dof_id_type, Index> position;
+    
+    for (std::size_t count = 0; count < border_nodes_.size(); ++count)
+    {
+        position[border_nodes_[count]] = count;
+    }
+    
+    ref_el = reference_mesh_.active_local_elements_begin();
+    
+    for ( ; ref_el != ref_end_el; ++ref_el)
+    {
+        const Elem * elem = *ref_el;
+        
+        for (unsigned int side = 0; side < elem->n_sides(); side++)
+        {
+            if (elem->neighbor(side) == NULL)
+            {
+                const dof_id_type following_node = elem->get_node((side + 1) % 3)->id();
+                
+                if ( position.find(following_node) == position.end() )
+                {
+                    position[following_node] = border_nodes_.size();
+                    border_nodes_.push_back(following_node);
+                }
+                
+                border_edges_.push_back(std::make_pair(position.at(elem->get_node(side)->id()), position.at(following_node)));
+            }
+        }
+    }
+    
+    normals_.resize(border_nodes_.size(), 2);
+    
     //Creating the B_ref Matrix
     Index K = CP_grid_.cols();
     Index L = CP_grid_.rows();
     Index LL = K * L;
     Index NB = border_ref_.size();
     
-    B_x.resize(NB, LL);
-    B_y.resize(NB, LL);
+    // The sparse path only pays off with B-splines, whose (p + 1)^2 nonzero values per row are few:
+    // the Bernstein polynomials are nonzero everywhere and B would just be a dense matrix in sparse format.
+    sparse_ = degree > 0 && LL > max_dense_control_points && min_sparsity_ratio * (degree + 1) * (degree + 1) <= LL;
+    
+    // With a square box beta H_x^2 B^T B + (1 - beta) I = beta H_y^2 B^T B + (1 - beta) I: one factorization serves both components.
+    shared_factorization_ = ( boundingBox_.second(0) - boundingBox_.first(0) == boundingBox_.second(1) - boundingBox_.first(1) );
+    const Index factorizationsNo = shared_factorization_ ? 1 : 2;
+    
+    if ( sparse_ )
+    {
+        // Only the nonzero basis values are stored, with the column l * K + k for the control point k, l.
+        std::vector<Triplet<Real> > triplets;
+        
+        for (Index i = 0; i < NB; ++i)
+        {
+            addBasisRow(psi(border_ref_[i]), i, triplets);
+        }
+        
+        sparse_B_.resize(NB, LL);
+        sparse_B_.setFromTriplets(triplets.begin(), triplets.end());
+        
+        const SparseXr BtB = sparse_B_.transpose() * sparse_B_;
+        
+        SparseXr identity(LL, LL);
+        identity.setIdentity();
+        
+        for (Index i = 0; i < factorizationsNo; ++i)
+        {
+            const Real H = boundingBox_.second(i) - boundingBox_.first(i);
+            
+            sparse_solvers_[i].compute( beta * H * H * BtB + (1 - beta) * identity );
+            
+            if ( sparse_solvers_[i].info() != Success )
+            {
+                throw std::runtime_error("FFD_LS(): the sparse factorization of the normal equations failed.");
+            }
+        }
+        
+        return;
+    }
+    
+    B_.resize(NB, LL);
+    
+    MatrixXr basis;
     
     for (Index i = 0; i < NB; ++i)
     {
+        evaluateBasis(psi(border_ref_[i]), basis);
+        
         for (Index ll = 0; ll < LL; ++ll)
         {
             Index k = ll % K;
             Index l = ll / K;
-            B_x(i, ll) = basisFunction(psi(border_ref_[i]), k, l) * (boundingBox_.second(0) - boundingBox_.first(0));
-            B_y(i, ll) = basisFunction(psi(border_ref_[i]), k, l) * (boundingBox_.second(1) - boundingBox_.first(1));
+            B_(i, ll) = basis(k, l);
         }
     }
     
-    solver_x.compute( beta * B_x.transpose() * B_x + (1 - beta) * MatrixXd::Identity(LL, LL) );
-    solver_y.compute( beta * B_y.transpose() * B_y + (1 - beta) * MatrixXd::Identity(LL, LL) );
+    // B_x and B_y only differ by the box extents: B^T B is computed once for both components.
+    const MatrixXr BtB = B_.transpose() * B_;
+    
+    for (Index i = 0; i < factorizationsNo; ++i)
+    {
+        const Real H = boundingBox_.second(i) - boundingBox_.first(i);
+        
+        solvers_[i].compute( beta * H * H * BtB + (1 - beta) * MatrixXr::Identity(LL, LL) );
+    }
+}
+
+MatrixXr FFD_LS::solveNormalEquations(const Index & i, const MatrixXr & rhs) const
+{
+    if ( sparse_ )
+    {
+        return sparse_solvers_[i].solve(rhs);
+    }
+    
+    return solvers_[i].solve(rhs);
 }
 
 void FFD_LS::computePerturbation(EquationSystems & perturbation, EquationSystems & stateAdj)
@@ -51,84 +149,80 @@ void FFD_LS::computePerturbation(EquationSystems & perturbation, EquationSystems
     Index LL = K * L;
     Index NB = border_ref_.size();
     
-    VectorXd f1(NB);
-    VectorXd f2(NB);
-    
-    Mesh::const_element_iterator       el     = mesh_->active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh_->active_local_elements_end();
+    // One column per component.
+    MatrixXr f(NB, 2);
     
     /*
      * Compute the average between the two adjacent edge normals for each boundary vertex.
      */
-    std::map<Index, Point> normals;
+    normals_.setZero();
     
-    for ( ; el != end_el; ++el)
+    for (std::size_t e = 0; e < border_edges_.size(); ++e)
     {
-        const Elem * elem = *el;
+        const Node & node           = mesh_->node(border_nodes_[border_edges_[e].first]);
+        const Node & following_node = mesh_->node(border_nodes_[border_edges_[e].second]);
         
-        for (unsigned int side = 0; side < elem->n_sides(); side++)
-        {
-            if (elem->neighbor(side) == NULL)
-            {
-                Node * node           = elem->get_node(side);
-                Node * following_node = elem->get_node((side + 1) % 3);
-                
-                Real deltax = (*following_node)(0) - (*node)(0);
-                Real deltay = (*following_node)(1) - (*node)(1);
-                
-                // Somma vettoriale tra le due normali.
-                normals[node->id()](0) += deltax;
-                normals[node->id()](1) += deltay;
-                
-                normals[following_node->id()](0) += deltax;
-                normals[following_node->id()](1) += deltay;
-            }
-        }
+        Real deltax = following_node(0) - node(0);
+        Real deltay = following_node(1) - node(1);
+        
+        // Somma vettoriale tra le due normali.
+        normals_(border_edges_[e].first, 0) += deltax;
+        normals_(border_edges_[e].first, 1) += deltay;
+        
+        normals_(border_edges_[e].second, 0) += deltax;
+        normals_(border_edges_[e].second, 1) += deltay;
     }
     
-    //
-    
-    el = mesh_->active_local_elements_begin();
-    Index count = 0;
+    for (Index n = 0; n < normals_.rows(); ++n)
+    {
+        normals_.row(n) /= normals_.row(n).norm();
+    }
     
-    for ( ; el != end_el; ++el)
+    for (Index count = 0; count < NB; ++count)
     {
-        const Elem * elem = *el;
+        const Node & node = mesh_->node(border_nodes_[count]);
         
-        for (unsigned int side = 0; side < elem->n_sides(); side++)
+        Real g = problem_.computeGradient(stateAdj, stateAdj.get_mesh().elem(border_elems_[count]), border_reference_points_[count]) + actual_lagrange_;
+        
+        Real nx = normals_(count, 0);
+        Real ny = normals_(count, 1);
+        
+        f(count, 0) = node(0) - step_ * g * ny - border_ref_[count](0);
+        f(count, 1) = node(1) + step_ * g * nx - border_ref_[count](1);
+    }
+    
+    // Solve ( beta H_i^2 B^T B + (1 - beta) I ) mu_i = H_i B^T f_i for both components.
+    MatrixXr mu;
+    
+    if ( sparse_ )
+    {
+        mu = sparse_B_.transpose() * f;
+    }
+    else
+    {
+        mu = B_.transpose() * f;
+    }
+    
+    if ( shared_factorization_ )
+    {
+        // One blocked solve with both components as right-hand side.
+        mu = (boundingBox_.second(0) - boundingBox_.first(0)) * solveNormalEquations(0, mu);
+    }
+    else
+    {
+        for (Index i = 0; i < 2; ++i)
         {
-            if (elem->neighbor(side) == NULL)
-            {
-                Node * node = elem->get_node(side);
-                
-                Real g = problem_.computeGradient(stateAdj, *node) + actual_lagrange_;
-                
-                Real nx = normals[node->id()](0);
-                Real ny = normals[node->id()](1);
-                
-                Real modulus = std::sqrt(nx * nx + ny * ny);
-                
-                nx /= modulus;
-                ny /= modulus;
-                
-                f1[count] = (*node)(0) - step_ * g * ny - border_ref_[count](0);
-                f2[count] = (*node)(1) + step_ * g * nx - border_ref_[count](1);
-                
-                // std::cout << (*node)(0) << " " << (*node)(1) << " " << f1[count] << " " << f2[count] << ";" << std::endl;
-                
-                ++count;
-            }
+            const Real H = boundingBox_.second(i) - boundingBox_.first(i);
+            
+            mu.col(i) = H * solveNormalEquations(i, mu.col(i));
         }
     }
     
-    VectorXd mu_x = solver_x.solve(B_x.transpose() * f1);
-    VectorXd mu_y = solver_y.solve(B_y.transpose() * f2);
-    
     for (Index ll = 0; ll < LL; ++ll)
     {
         Index k = ll % K;
         Index l = ll / K;
-        gradJ_(L - 1 - l, k)(0) = (mu_(L - 1 - l, k)(0) - mu_x(ll)) / step_; // So that mu_ = - [mu_x, mu_y];
-        gradJ_(L - 1 - l, k)(1) = (mu_(L - 1 - l, k)(1) - mu_y(ll)) / step_;
+        gradJ_(L - 1 - l, k)(0) = (mu_(L - 1 - l, k)(0) - mu(ll, 0)) / step_; // So that mu_ = - [mu_x, mu_y];
+        gradJ_(L - 1 - l, k)(1) = (mu_(L - 1 - l, k)(1) - mu(ll, 1)) / step_;
     }
 }
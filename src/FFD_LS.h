@@ -35,6 +35,16 @@
  * @f[
  *    \vec{\theta}_{FFD,i} = B_i  \vec{\mu}_i
  * @f]
+ * Poiché @f$ B_i = H_i B @f$, dove @f$ H_i @f$ è il lato della scatola nella direzione @f$ i @f$, si memorizza la sola @f$ B @f$
+ * e le matrici dei due sistemi si ottengono dall'unico prodotto @f$ B^T B @f$:
+ * @f[
+ *    \left( \beta H_i^2 B^T B + (1 - \beta) I \right) \vec{\mu}_i = H_i B^T \vec{f}_i
+ * @f]
+ * Se la scatola ha i lati uguali le due matrici coincidono: una sola fattorizzazione risolve entrambe le componenti
+ * con un termine noto a due colonne. Altrimenti si calcolano due fattorizzazioni.
+ * Con le B-spline di grado @f$ p @f$, oltre @a max_dense_control_points control point e se ogni riga ha al più una frazione
+ * @f$ 1 / @f$ @a min_sparsity_ratio di valori non nulli @f$ (p + 1)^2 @f$, la matrice @f$ B @f$ viene memorizzata sparsa
+ * e le fattorizzazioni di Cholesky sono sparse.
  */
 class FFD_LS : public FFD
 {
@@ -51,9 +61,10 @@ class FFD_LS : public FFD
         * @param[in] sub               : Coppia contenente il numero di intervalli in cui suddividere la base e l'altezza della bounding box
         * @param[in] beta             : Parametro di rilassamento per il metodo dei minimi quadrati
         * @param[in] armijoSlope       : Coefficiente di rilassamento per la regola di Armijo.
+        * @param[in] degree            : Grado delle B-spline, zero per i polinomi di Bernstein
         *
         */
-        FFD_LS(const Problem &, const std::string &, const Real &, const Index &, const Real &, const bool &, const std::pair<Point, Point> &, const std::pair<Index, Index> &, const Real &, const Real & = 1.0e-4);
+        FFD_LS(const Problem &, const std::string &, const Real &, const Index &, const Real &, const bool &, const std::pair<Point, Point> &, const std::pair<Index, Index> &, const Real &, const Real & = 1.0e-4, const Index & = 0);
         
         /**
         * @brief Calcola la deformazione della mesh
@@ -63,15 +74,36 @@ class FFD_LS : public FFD
         */
         virtual void computePerturbation(EquationSystems &, EquationSystems &);
         
+        static const Index max_dense_control_points = 400;  /**< @brief Numero massimo di control point per la risoluzione densa */
+        static const Index min_sparsity_ratio = 10;         /**< @brief Rapporto minimo tra i control point e i valori non nulli per riga per la risoluzione sparsa */
+        
     protected:
+        /**
+        * @brief Risolve il sistema dei minimi quadrati con la fattorizzazione richiesta
+        * @param[in] i   : indice della fattorizzazione
+        * @param[in] rhs : termine noto, con una o due colonne
+        * @return la soluzione, con lo stesso numero di colonne di @a rhs
+        *
+        */
+        MatrixXr solveNormalEquations(const Index &, const MatrixXr &) const;
+        
         Real beta_;    /**< @brief Parametro di rilassamento per il metodo dei minimi quadrati */
         
         std::vector<Point> border_ref_;   /**< @brief Vettore contenente i punti del bordo*/
-        MatrixXr B_x;   /**< @brief Matrice con righe pari al numero di punti sul bordo e colonne pari al numero totale di control point. Rappresenta @f$ \left( b_{k,\ell}^{K, L} ( \vec{\psi} (\vec{x})) \mathfrak{B} \right)_x @f$ per i nodi del bordo */
-        MatrixXr B_y;   /**< @brief Matrice con righe pari al numero di punti sul bordo e colonne pari al numero totale di control point. Rappresenta @f$ \left( b_{k,\ell}^{K, L} ( \vec{\psi} (\vec{x})) \mathfrak{B} \right)_y @f$ per i nodi del bordo */
         
-        LDLT<MatrixXr> solver_x; /**< @brief Robust Cholesky Decomposition con pivoting della matrice @f$ \beta B\_x^T B\_x + (1 - \beta ) I @f$ */
-        LDLT<MatrixXr> solver_y; /**< @brief Robust Cholesky Decomposition con pivoting della matrice @f$ \beta B\_y^T B\_y + (1 - \beta ) I @f$ */
+        std::vector<dof_id_type> border_nodes_;                 /**< @brief indici dei nodi del bordo: i primi nello stesso ordine di @a border_ref_ */
+        std::vector<std::pair<Index, Index> > border_edges_;    /**< @brief lati del bordo, come coppie di posizioni in @a border_nodes_ */
+        std::vector<dof_id_type> border_elems_;                 /**< @brief per ogni punto di @a border_ref_, elemento che lo contiene */
+        std::vector<Point> border_reference_points_;            /**< @brief per ogni punto di @a border_ref_, coordinate nell'elemento di riferimento */
+        MatrixXr normals_;                                      /**< @brief somma dei due lati adiacenti a ogni nodo del bordo, una riga per nodo */
+        MatrixXr B_;    /**< @brief Matrice con righe pari al numero di punti sul bordo e colonne pari al numero totale di control point. Rappresenta @f$ b_{k,\ell}^{K, L} ( \vec{\psi} (\vec{x})) @f$ per i nodi del bordo */
+        
+        bool shared_factorization_;                     /**< @brief vero se i lati della scatola sono uguali e una sola fattorizzazione serve entrambe le componenti */
+        LDLT<MatrixXr> solvers_[2];                     /**< @brief Fattorizzazioni di @f$ \beta H_i^2 B^T B + (1 - \beta) I @f$, una per componente o una sola se condivisa */
+        
+        bool sparse_;                                   /**< @brief vero se @f$ B @f$ è memorizzata sparsa */
+        SparseXr sparse_B_;                             /**< @brief Matrice @f$ B @f$ sparsa */
+        SimplicialLDLT<SparseXr> sparse_solvers_[2];    /**< @brief Fattorizzazioni sparse di @f$ \beta H_i^2 B^T B + (1 - \beta) I @f$, una per componente o una sola se condivisa */
 };
 
 #endif /* FFD_LS_H */
@@ -0,0 +1,120 @@
+#include "MeshDeformer.h"
+
+MeshDeformer::MeshDeformer(const MeshBase & mesh, const Problem & problem)
+    : dim_(mesh.mesh_dimension())
+{
+    std::vector<bool> isListed(mesh.max_node_id(), false);
+    
+    MeshBase::const_element_iterator       el     = mesh.active_local_elements_begin();
+    const MeshBase::const_element_iterator end_el = mesh.active_local_elements_end();
+    
+    for ( ; el != end_el ; ++el )
+    {
+        const Elem * elem = *el;
+        
+        for ( Index n = 0; n < elem->n_vertices(); ++n ) // loop over vertices
+        {
+            const Node * node = elem->get_node(n);
+            
+            if ( !isListed[node->id()] && problem.toBeMoved(*node) )
+            {
+                vertices_.push_back(node->id());
+                
+                isListed[node->id()] = true;
+            }
+        }
+    }
+    
+    el = mesh.active_local_elements_begin();
+    
+    for ( ; el != end_el ; ++el )
+    {
+        const Elem * elem = *el;
+        
+        Index subPerSide = elem->n_nodes() / 3 - 1;
+        
+        for ( Index n = elem->n_vertices(); n < elem->n_nodes(); ++n ) // loop over non-vertices
+        {
+            const Node * node = elem->get_node(n);
+            
+            if ( !isListed[node->id()] && problem.toBeMoved(*node) )
+            {
+                Index idA = (n - 3) / subPerSide;              // ID del vertice precedente.
+                Index idB = ((n - 3 + 1) / subPerSide) % 3;    // ID del vertice successivo.
+                
+                SideNode side_node;
+                
+                side_node.node     = node->id();
+                side_node.vertex_a = elem->get_node(idA)->id();
+                side_node.vertex_b = elem->get_node(idB)->id();
+                side_node.weight   = 1.0 / (subPerSide + 1) * ((n - 3) - subPerSide * idA + 1); // 1/(#nodi per lato+1) * (che ordinamento ha il nodo nel lato)
+                
+                side_nodes_.push_back(side_node);
+                
+                isListed[node->id()] = true;
+            }
+        }
+    }
+}
+
+void MeshDeformer::setVertices(MeshBase & mesh, const MatrixXr & positions) const
+{
+    libmesh_assert_equal_to(static_cast<std::size_t>(positions.rows()), vertices_.size());
+    
+    ThreadedLoop::run(vertices_.size(), [this, &mesh, &positions](const std::size_t & begin, const std::size_t & end)
+    {
+        for ( std::size_t v = begin; v < end; ++v )
+        {
+            Node & node = mesh.node(vertices_[v]);
+            
+            for ( unsigned int c = 0; c < dim_; ++c )
+            {
+                node(c) = positions(v, c);
+            }
+        }
+    });
+    
+    placeSideNodes(mesh);
+}
+
+void MeshDeformer::displaceVertices(MeshBase & mesh, const MatrixXr & displacements) const
+{
+    libmesh_assert_equal_to(static_cast<std::size_t>(displacements.rows()), vertices_.size());
+    
+    ThreadedLoop::run(vertices_.size(), [this, &mesh, &displacements](const std::size_t & begin, const std::size_t & end)
+    {
+        for ( std::size_t v = begin; v < end; ++v )
+        {
+            Node & node = mesh.node(vertices_[v]);
+            
+            for ( unsigned int c = 0; c < dim_; ++c )
+            {
+                node(c) += displacements(v, c);
+            }
+        }
+    });
+    
+    placeSideNodes(mesh);
+}
+
+void MeshDeformer::placeSideNodes(MeshBase & mesh) const
+{
+    // The vertices have all been moved: each side node only reads them.
+    ThreadedLoop::run(side_nodes_.size(), [this, &mesh](const std::size_t & begin, const std::size_t & end)
+    {
+        for ( std::size_t s = begin; s < end; ++s )
+        {
+            const SideNode & side_node = side_nodes_[s];
+            
+            Node & node = mesh.node(side_node.node);
+            
+            const Point & node1 = mesh.point(side_node.vertex_a);
+            const Point & node2 = mesh.point(side_node.vertex_b);
+            
+            for ( unsigned int c = 0; c < dim_; ++c )
+            {
+                node(c) = side_node.weight * ( node1(c) + node2(c) );
+            }
+        }
+    });
+}
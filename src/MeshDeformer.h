@@ -0,0 +1,102 @@
+/* C++ */
+
+/**
+ * @file   MeshDeformer.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef MESHDEFORMER_H
+#define MESHDEFORMER_H
+
+#include "typedefs.h"
+
+#include "Problem.h"
+#include "ThreadedLoop.h"
+
+/**
+ * @class MeshDeformer
+ *
+ * @brief Classe che sposta i nodi della mesh, comune a tutte le tecniche di ottimizzazione
+ *
+ * La connettività della mesh non cambia durante l'ottimizzazione: l'elenco dei vertici da spostare e,
+ * per ogni nodo interno ai lati, i due vertici del lato e il peso con cui viene ricostruito, vengono
+ * calcolati una sola volta. Ogni deformazione diventa così un ciclo sui vertici seguito da un ciclo
+ * sui nodi interni ai lati, entrambi divisi tra i thread con ThreadedLoop.
+ *
+ */
+class MeshDeformer
+{
+    public:
+        /**
+         * @brief Costruttore: raccoglie i vertici da spostare e i nodi interni ai lati
+         * @param[in] mesh    : mesh da deformare
+         * @param[in] problem : problema, che stabilisce quali nodi spostare
+         *
+         */
+        MeshDeformer(const MeshBase &, const Problem &);
+        
+        /**
+         * @brief Restituisce gli indici dei vertici da spostare
+         * @return gli indici dei vertici, nell'ordine delle righe attese da setVertices() e displaceVertices()
+         *
+         */
+        inline const std::vector<dof_id_type> & get_vertices() const;
+        
+        /**
+         * @brief Assegna le nuove coordinate dei vertici e ricostruisce i nodi interni ai lati
+         * @param[in,out] mesh      : mesh da deformare
+         * @param[in]     positions : coordinate dei vertici, una riga per vertice e una colonna per direzione
+         *
+         */
+        void setVertices(MeshBase &, const MatrixXr &) const;
+        
+        /**
+         * @brief Somma gli spostamenti ai vertici e ricostruisce i nodi interni ai lati
+         * @param[in,out] mesh          : mesh da deformare
+         * @param[in]     displacements : spostamenti dei vertici, una riga per vertice e una colonna per direzione
+         *
+         */
+        void displaceVertices(MeshBase &, const MatrixXr &) const;
+        
+    private:
+        /**
+         * @struct SideNode
+         * @brief Nodo interno a un lato, ricostruito come @f$ w (x_A + x_B) @f$ dai due vertici del lato
+         *
+         */
+        struct SideNode
+        {
+            dof_id_type node;       /**< @brief indice del nodo */
+            dof_id_type vertex_a;   /**< @brief indice del vertice precedente */
+            dof_id_type vertex_b;   /**< @brief indice del vertice successivo */
+            Real weight;            /**< @brief peso @f$ w @f$ */
+        };
+        
+        /**
+         * @brief Ricostruisce i nodi interni ai lati dalle coordinate correnti dei vertici
+         * @param[in,out] mesh : mesh da deformare
+         *
+         */
+        void placeSideNodes(MeshBase &) const;
+        
+        std::vector<dof_id_type> vertices_;     /**< @brief indici dei vertici da spostare */
+        std::vector<SideNode> side_nodes_;      /**< @brief nodi interni ai lati da ricostruire */
+        
+        unsigned int dim_;                      /**< @brief dimensione della mesh */
+};
+
+inline const std::vector<dof_id_type> & MeshDeformer::get_vertices() const
+{
+    return vertices_;
+}
+
+#endif /* MESHDEFORMER_H */
@@ -1,4 +1,372 @@
 #include "Problem.h"
 
 Problem::Problem(Mesh mesh)
-    : mesh_(std::make_shared<Mesh>(mesh)) {}
+    : mesh_(std::make_shared<Mesh>(mesh)), boundary_cache_(FEType(SECOND, LAGRANGE), FEType(SECOND, LAGRANGE).default_quadrature_order()),
+      functional_cache_(FEType(SECOND, LAGRANGE), FEType(FIRST, LAGRANGE).default_quadrature_order()), direct_solver_(false),
+      reference_extension_(false), reference_laplacian_(FEType(SECOND, LAGRANGE)) {}
+
+const BoundaryQuadratureCache & Problem::get_boundary_cache(const MeshBase & mesh) const
+{
+    if ( !boundary_cache_.isValid(mesh) )
+    {
+        boundary_cache_.reinit(mesh);
+    }
+    
+    return boundary_cache_;
+}
+
+const BoundaryQuadratureCache & Problem::get_functional_cache(const MeshBase & mesh) const
+{
+    if ( !functional_cache_.isValid(mesh) )
+    {
+        functional_cache_.reinit(mesh);
+    }
+    
+    return functional_cache_;
+}
+
+void Problem::invalidateBoundaryCache() const
+{
+    boundary_cache_.clear();
+    functional_cache_.clear();
+}
+
+void Problem::set_linear_solver(const std::string & linear_solver)
+{
+    if ( linear_solver == "iterative" )
+    {
+        direct_solver_ = false;
+    }
+    else if ( linear_solver == "direct" )
+    {
+        direct_solver_ = true;
+    }
+    else
+    {
+        throw std::runtime_error("set_linear_solver(): unknown linear solver \"" + linear_solver + "\".");
+    }
+}
+
+void Problem::set_harmonic_extension(const std::string & harmonic_extension)
+{
+    if ( harmonic_extension == "current" )
+    {
+        reference_extension_ = false;
+    }
+    else if ( harmonic_extension == "reference" )
+    {
+        reference_extension_ = true;
+    }
+    else
+    {
+        throw std::runtime_error("set_harmonic_extension(): unknown harmonic extension \"" + harmonic_extension + "\".");
+    }
+}
+
+void Problem::addElementMatrixAndVector(LinearImplicitSystem & system, const DenseMatrix<Number> & Ke, const DenseVector<Number> & Fe, const std::vector<dof_id_type> & dof_indices) const
+{
+    if ( direct_solver_ )
+    {
+        direct_solvers_.at(system.name())->add(Ke, Fe, dof_indices);
+    }
+    else
+    {
+        system.matrix->add_matrix (Ke, dof_indices);
+        system.rhs->add_vector    (Fe, dof_indices);
+    }
+}
+
+void Problem::addElementVector(ExplicitSystem & system, const DenseVector<Number> & Fe, const std::vector<dof_id_type> & dof_indices) const
+{
+    if ( direct_solver_ )
+    {
+        direct_solvers_.at(system.name())->add(Fe, dof_indices);
+    }
+    else
+    {
+        system.rhs->add_vector (Fe, dof_indices);
+    }
+}
+
+void Problem::assembleInThreads(ExplicitSystem & system, const std::function<void (const ConstElemRange &, AssemblyBuffer &)> & assembleRange,
+                                const std::function<void (const AssemblyBuffer::Contribution &)> & insert) const
+{
+    const MeshBase & mesh = system.get_mesh();
+    
+    ConstElemRange range(mesh.active_local_elements_begin(), mesh.active_local_elements_end());
+    
+    // Each subrange fills its own buffer: the lock is only taken once per subrange, to store it.
+    // The buffers are keyed by the position of the subrange, so the insertion follows the element order
+    // whatever the splitting and the scheduling of the threads.
+    std::map<std::size_t, std::shared_ptr<AssemblyBuffer> > buffers;
+    Threads::spin_mutex mutex;
+    
+    ThreadedLoop::run<ConstElemRange>(range, [&assembleRange, &buffers, &mutex](const ConstElemRange & subrange)
+    {
+        std::shared_ptr<AssemblyBuffer> buffer = std::make_shared<AssemblyBuffer>();
+        
+        assembleRange(subrange, *buffer);
+        
+        Threads::spin_mutex::scoped_lock lock(mutex);
+        buffers[subrange.first_idx()] = buffer;
+    });
+    
+    for (std::map<std::size_t, std::shared_ptr<AssemblyBuffer> >::const_iterator b = buffers.begin(); b != buffers.end(); ++b)
+    {
+        const std::vector<AssemblyBuffer::Contribution> & contributions = b->second->get_contributions();
+        
+        for (std::size_t c = 0; c < contributions.size(); c++)
+        {
+            const AssemblyBuffer::Contribution & contribution = contributions[c];
+            
+            if ( contribution.has_matrix )
+            {
+                // Only the systems with a matrix produce matrix contributions.
+                addElementMatrixAndVector(libmesh_cast_ref<LinearImplicitSystem &>(system), contribution.Ke, contribution.Fe, contribution.dof_indices);
+            }
+            else
+            {
+                addElementVector(system, contribution.Fe, contribution.dof_indices);
+            }
+            
+            if ( insert )
+            {
+                insert(contribution);
+            }
+        }
+    }
+}
+
+void Problem::solveSystem(LinearImplicitSystem & system, const bool & symmetric) const
+{
+    if ( !direct_solver_ )
+    {
+        loadInitialGuess(system);
+        system.solve();
+        storeInitialGuess(system);
+        
+        return;
+    }
+    
+    // The solver of each system is kept, together with its symbolic factorization.
+    std::shared_ptr<DirectSolver> & solver = direct_solvers_[system.name()];
+    
+    if ( !solver )
+    {
+        solver = std::make_shared<DirectSolver>(symmetric);
+    }
+    
+    solver->begin(system);
+    system.user_assembly();
+    solver->solve(system);
+}
+
+void Problem::solveSystem(LinearImplicitSystem & system, LinearImplicitSystem & shared) const
+{
+    if ( direct_solver_ )
+    {
+        std::shared_ptr<DirectSolver> & solver = direct_solvers_[system.name()];
+        
+        if ( !solver )
+        {
+            solver = std::make_shared<DirectSolver>();
+        }
+        
+        solver->begin(system);
+        system.user_assembly();
+        solver->solve(system, *direct_solvers_.at(shared.name()));
+        
+        return;
+    }
+    
+    loadInitialGuess(system);
+    
+    system.rhs->zero();
+    system.user_assembly();
+    system.rhs->close();
+    
+    // The matrix of the shared system has not changed since its solve,
+    // so PETSc keeps its preconditioner instead of recomputing it.
+    const Parameters & parameters = system.get_equation_systems().parameters;
+    
+    shared.get_linear_solver()->solve(*shared.matrix, *system.solution, *system.rhs,
+                                      parameters.get<Real>("linear solver tolerance"),
+                                      parameters.get<unsigned int>("linear solver maximum iterations"));
+                 
+    system.get_dof_map().enforce_constraints_exactly(system);
+    system.update();
+    
+    storeInitialGuess(system);
+}
+
+void Problem::solveSystem(ExplicitSystem & system, LinearSolver<Number> & solver, const ShellMatrix<Number> & shell) const
+{
+    loadInitialGuess(system);
+    
+    system.rhs->zero();
+    system.user_assembly();
+    system.rhs->close();
+    
+    const Parameters & parameters = system.get_equation_systems().parameters;
+    
+    solver.solve(shell, *system.solution, *system.rhs,
+                 parameters.get<Real>("linear solver tolerance"),
+                 parameters.get<unsigned int>("linear solver maximum iterations"));
+                 
+    system.get_dof_map().enforce_constraints_exactly(system);
+    system.update();
+    
+    storeInitialGuess(system);
+}
+
+void Problem::loadInitialGuess(System & system) const
+{
+    // Warm start from the previous solution of the same system: the mesh topology
+    // does not change during the optimization, hence neither does the DOF numbering.
+    const std::vector<Number> & initial_guess = initial_guesses_[system.name()];
+    
+    if ( initial_guess.size() == system.n_dofs() )
+    {
+        for (dof_id_type i = 0; i < initial_guess.size(); i++)
+        {
+            system.solution->set(i, initial_guess[i]);
+        }
+        
+        system.solution->close();
+    }
+}
+
+void Problem::storeInitialGuess(const System & system) const
+{
+    system.solution->localize(initial_guesses_[system.name()]);
+}
+
+void Problem::referenceExtension(LinearImplicitSystem & system, EquationSystems & stateAdj, const Real & lagrange, const std::set<boundary_id_type> & dirichlet_ids, const std::set<boundary_id_type> & traction_ids) const
+{
+    const MeshBase & mesh = system.get_mesh();
+    
+    if ( !reference_laplacian_.isInitialized() )
+    {
+        reference_laplacian_.init(mesh, dirichlet_ids);
+    }
+    
+    // Boundary traction on the current mesh, one column per displacement component.
+    const BoundaryQuadratureCache & cache = get_boundary_cache(stateAdj.get_mesh());
+    const std::vector<BoundaryQuadratureCache::Side> & sides = cache.get_sides();
+    
+    MatrixXr rhs = MatrixXr::Zero(mesh.max_node_id(), 2);
+    
+    std::vector<Real> gradient;
+    
+    for (std::size_t s = 0; s < sides.size(); s++)
+    {
+        const BoundaryQuadratureCache::Side & side = sides[s];
+        
+        bool traction = false;
+        
+        for (std::set<boundary_id_type>::const_iterator id = traction_ids.begin(); id != traction_ids.end() && !traction; ++id)
+        {
+            traction = side.has_boundary_id(*id);
+        }
+        
+        if ( !traction )
+        {
+            continue;
+        }
+        
+        computeGradient(stateAdj, side, gradient);
+        
+        for (unsigned int qp = 0; qp < cache.n_points(); qp++)
+        {
+            Real g = - gradient[qp] - lagrange;
+            
+            // The state mesh and the perturbation mesh share the node numbering.
+            for (unsigned int i = 0; i < side.phi.size(); i++)
+            {
+                const dof_id_type node = side.elem->get_node(i)->id();
+                
+                rhs(node, 0) += g * side.JxW[qp] * side.normals[qp](0) * side.phi[i][qp];
+                rhs(node, 1) += g * side.JxW[qp] * side.normals[qp](1) * side.phi[i][qp];
+            }
+        }
+    }
+    
+    MatrixXr solution;
+    reference_laplacian_.solve(rhs, solution);
+    
+    const unsigned int u_var = system.variable_number ("u");
+    const unsigned int v_var = system.variable_number ("v");
+    
+    MeshBase::const_node_iterator       nd     = mesh.nodes_begin();
+    const MeshBase::const_node_iterator end_nd = mesh.nodes_end();
+    
+    for ( ; nd != end_nd; ++nd)
+    {
+        const Node * node = *nd;
+        
+        system.solution->set(node->dof_number(system.number(), u_var, 0), solution(node->id(), 0));
+        system.solution->set(node->dof_number(system.number(), v_var, 0), solution(node->id(), 1));
+    }
+    
+    system.solution->close();
+    system.update();
+}
+
+void Problem::faceValues(const System & system, const unsigned int & var, const BoundaryQuadratureCache::Side & side, std::vector<Number> & values) const
+{
+    // The DOF indices and the coefficients are read once for all the quadrature nodes of the side.
+    std::vector<dof_id_type> dof_indices;
+    system.get_dof_map().dof_indices (side.elem, dof_indices, var);
+    
+    values.assign(side.xyz.size(), 0.0);
+    
+    for (unsigned int i = 0; i < dof_indices.size(); i++)
+    {
+        const Number coefficient = system.current_solution(dof_indices[i]);
+        
+        for (unsigned int qp = 0; qp < values.size(); qp++)
+        {
+            values[qp] += side.phi[i][qp] * coefficient;
+        }
+    }
+}
+
+void Problem::faceGradients(const System & system, const unsigned int & var, const BoundaryQuadratureCache::Side & side, std::vector<Gradient> & gradients) const
+{
+    // The DOF indices and the coefficients are read once for all the quadrature nodes of the side.
+    std::vector<dof_id_type> dof_indices;
+    system.get_dof_map().dof_indices (side.elem, dof_indices, var);
+    
+    gradients.assign(side.xyz.size(), Gradient());
+    
+    for (unsigned int i = 0; i < dof_indices.size(); i++)
+    {
+        const Number coefficient = system.current_solution(dof_indices[i]);
+        
+        for (unsigned int qp = 0; qp < gradients.size(); qp++)
+        {
+            gradients[qp].add_scaled(side.dphi[i][qp], coefficient);
+        }
+    }
+}
+
+Gradient Problem::elementGradient(const System & system, const unsigned int & var, const Elem * elem, const Point & reference_point) const
+{
+    AutoPtr<FEBase> fe (FEBase::build(elem->dim(), system.variable_type(var)));
+    const std::vector<std::vector<RealGradient> > & dphi = fe->get_dphi();
+    
+    const std::vector<Point> points(1, reference_point);
+    fe->reinit(elem, &points);
+    
+    std::vector<dof_id_type> dof_indices;
+    system.get_dof_map().dof_indices (elem, dof_indices, var);
+    
+    Gradient grad;
+    
+    for (unsigned int i = 0; i < dof_indices.size(); i++)
+    {
+        grad.add_scaled(dphi[i][0], system.current_solution(dof_indices[i]));
+    }
+    
+    return grad;
+}
@@ -19,6 +19,28 @@
 
 #include "typedefs.h"
 
+#include <functional>
+#include <map>
+
+#include "AssemblyBuffer.h"
+#include "BoundaryQuadratureCache.h"
+#include "DirectSolver.h"
+#include "ReferenceLaplacian.h"
+#include "ThreadedLoop.h"
+
+/**
+ * @struct BoundaryFunctionals
+ *
+ * @brief Integrali di bordo necessari ad ogni iterazione dell'ottimizzazione
+ *
+ */
+struct BoundaryFunctionals
+{
+    Real cost;        /**< @brief valore del funzionale costo */
+    Real gradJ2;      /**< @brief norma @f$ L^2 @f$ al quadrato del gradiente */
+    Real lagrange;    /**< @brief moltiplicatore di lagrange, come restituito da Problem::lagrangeMult */
+};
+
 /**
  * @class Problem
  *
@@ -47,6 +69,9 @@ class Problem
          * @param[out] stateAdj       : Sistema d'equazioni che conterrà lo stato e l'aggiunto
          * @param[in] maxIterationsNo : Numero massimo di iterazioni
          *
+         * Se @a stateAdj contiene già i sistemi (iterazioni successive alla prima),
+         * questi vengono soltanto riassemblati e risolti sulla mesh deformata.
+         *
          */
         virtual void resolveStateAndAdjointEquation(EquationSystems & stateAdj, const Index & maxIterationsNo) const = 0;
         
@@ -67,6 +92,30 @@ class Problem
          */
         virtual Real computeGradient(EquationSystems & stateAdj, const Point & p) const = 0;
         
+        /**
+         * @brief Metodo astratto per calcolare il valore del gradiente del funzionale costo nei nodi di quadratura di un lato di bordo
+         * @param[in]  stateAdj : Sistema d'equazioni che contiene lo stato e l'aggiunto
+         * @param[in]  side     : Lato di bordo, preso da get_boundary_cache() o da get_functional_cache()
+         * @param[out] gradient : valori del gradiente, uno per nodo di quadratura del lato
+         *
+         * Il gradiente viene ricostruito dai gradi di libertà locali dell'elemento, letti una sola volta per lato,
+         * senza alcuna ricerca del punto nella mesh.
+         *
+         */
+        virtual void computeGradient(EquationSystems & stateAdj, const BoundaryQuadratureCache::Side & side, std::vector<Real> & gradient) const = 0;
+        
+        /**
+         * @brief Metodo astratto per calcolare il valore del gradiente del funzionale costo in un punto di un elemento noto
+         * @param[in] stateAdj        : Sistema d'equazioni che contiene lo stato e l'aggiunto
+         * @param[in] elem            : Elemento che contiene il punto
+         * @param[in] reference_point : Coordinate del punto nell'elemento di riferimento
+         * @return  il valore del gradiente nel punto
+         *
+         * Il gradiente viene ricostruito dai gradi di libertà locali dell'elemento, senza alcuna ricerca del punto nella mesh.
+         *
+         */
+        virtual Real computeGradient(EquationSystems & stateAdj, const Elem * elem, const Point & reference_point) const = 0;
+        
         /**
          * @brief Metodo astratto per calcolare la norma @f$ L^2 @f$ del gradiente
          * @param[in] stateAdj : Sistema d'equazioni che contiene lo stato e l'aggiunto
@@ -83,6 +132,8 @@ class Problem
          * @param[in] stateAdj        : Sistema d'equazioni contenente stato e aggiunto
          * @param[in] lagrange        : lagrangiano
          *
+         * Come per lo stato, il sistema viene creato solo se non è già presente in @a perturbation.
+         *
          */
         virtual void harmonicExtension(EquationSystems & perturbation, EquationSystems & stateAdj, const Real & lagrange) const = 0;
         
@@ -112,6 +163,16 @@ class Problem
          */
         virtual Real lagrangeMult(EquationSystems & stateAdj) const = 0;
         
+        /**
+         * @brief Metodo astratto che calcola in un'unica visita del bordo tutti gli integrali necessari ad un'iterazione
+         * @param[in] stateAdj : Sistema d'equazioni contenente stato e aggiunto
+         * @return il funzionale costo, la norma @f$ L^2 @f$ al quadrato del gradiente e il moltiplicatore di lagrange
+         *
+         * Il gradiente viene valutato una sola volta per ogni nodo di quadratura di bordo.
+         *
+         */
+        virtual BoundaryFunctionals evaluateBoundaryFunctionals(EquationSystems & stateAdj) const = 0;
+        
         /**
          * @brief Restituisce un puntatore alla mesh del problema
          * @return il puntatore alla mesh
@@ -126,10 +187,183 @@ class Problem
          */
         inline std::string get_name() const;
         
+        /**
+         * @brief Restituisce i dati di quadratura sul bordo della mesh, ricostruendoli se necessario
+         * @param[in] mesh : mesh su cui sono definiti lo stato e l'aggiunto
+         * @return la cache dei dati di quadratura di bordo
+         *
+         */
+        const BoundaryQuadratureCache & get_boundary_cache(const MeshBase &) const;
+        
+        /**
+         * @brief Restituisce i dati di quadratura sul bordo usati dai funzionali di bordo, ricostruendoli se necessario
+         *
+         * La formula di quadratura è quella degli elementi del primo ordine, come nel calcolo originale
+         * del funzionale costo, di @f$ \| \nabla J \|^2 @f$ e del moltiplicatore di Lagrange.
+         *
+         * @param[in] mesh : mesh su cui sono definiti lo stato e l'aggiunto
+         * @return la cache dei dati di quadratura di bordo per i funzionali
+         *
+         */
+        const BoundaryQuadratureCache & get_functional_cache(const MeshBase &) const;
+        
+        /**
+         * @brief Invalida i dati di quadratura di bordo: va chiamato ogni volta che la mesh viene deformata
+         *
+         */
+        void invalidateBoundaryCache() const;
+        
+        /**
+         * @brief Seleziona il risolutore dei sistemi lineari
+         * @param[in] linear_solver : "iterative" per i metodi di Krylov di libMesh, "direct" per la fattorizzazione sparsa di DirectSolver
+         *
+         */
+        void set_linear_solver(const std::string &);
+        
+        /**
+         * @brief Seleziona l'operatore usato per l'estensione armonica
+         * @param[in] harmonic_extension : "current" per il laplaciano vettoriale sulla mesh corrente,
+         * riassemblato ad ogni iterazione; "reference" per il laplaciano scalare sulla mesh di riferimento,
+         * fattorizzato una sola volta e risolto per le due componenti
+         *
+         */
+        void set_harmonic_extension(const std::string &);
+        
+        /**
+         * @brief Somma il contributo di un elemento al sistema lineare, in base al risolutore selezionato
+         * @param[in,out] system      : sistema in fase di assemblaggio
+         * @param[in]     Ke          : matrice elementare, già vincolata
+         * @param[in]     Fe          : termine noto elementare, già vincolato
+         * @param[in]     dof_indices : indici globali dei gradi di libertà dell'elemento
+         *
+         */
+        void addElementMatrixAndVector(LinearImplicitSystem &, const DenseMatrix<Number> &, const DenseVector<Number> &, const std::vector<dof_id_type> &) const;
+        
+        /**
+         * @brief Somma il contributo di un elemento al solo termine noto, per i sistemi risolti con l'operatore di un altro sistema o matrix-free
+         * @param[in,out] system      : sistema in fase di assemblaggio, anche esplicito
+         * @param[in]     Fe          : termine noto elementare, già vincolato
+         * @param[in]     dof_indices : indici globali dei gradi di libertà dell'elemento
+         *
+         */
+        void addElementVector(ExplicitSystem &, const DenseVector<Number> &, const std::vector<dof_id_type> &) const;
+        
+        /**
+         * @brief Assembla in parallelo gli elementi attivi locali con ThreadedLoop, poi inserisce i contributi nel sistema
+         * @param[in,out] system        : sistema da assemblare
+         * @param[in]     assembleRange : funzione che assembla gli elementi di un intervallo; deve costruire
+         * i propri oggetti FE e le proprie matrici elementari e raccoglierle nel buffer del thread
+         * @param[in]     insert        : funzione opzionale chiamata dopo l'inserimento di ogni contributo, ad esempio
+         * per passare la matrice ausiliaria a un precondizionatore
+         *
+         * I contributi vengono inseriti in serie con addElementMatrixAndVector() o addElementVector() al termine del ciclo parallelo,
+         * nell'ordine degli elementi dell'intervallo: il risultato non dipende dal numero di thread né dal loro ordine di esecuzione.
+         * Tutte le matrici e i vettori elementari restano in memoria fino al termine del ciclo parallelo.
+         *
+         */
+        void assembleInThreads(ExplicitSystem &, const std::function<void (const ConstElemRange &, AssemblyBuffer &)> &,
+                               const std::function<void (const AssemblyBuffer::Contribution &)> & = std::function<void (const AssemblyBuffer::Contribution &)>()) const;
+        
     protected:
+        /**
+         * @brief Calcola il valore di una variabile nei nodi di quadratura di un lato di bordo a partire dai gradi di libertà locali
+         * @param[in]  system : Sistema contenente la soluzione
+         * @param[in]  var    : Indice della variabile
+         * @param[in]  side   : Lato di bordo
+         * @param[out] values : valori della variabile, uno per nodo di quadratura
+         *
+         */
+        void faceValues(const System &, const unsigned int &, const BoundaryQuadratureCache::Side &, std::vector<Number> &) const;
+        
+        /**
+         * @brief Calcola il gradiente di una variabile nei nodi di quadratura di un lato di bordo a partire dai gradi di libertà locali
+         * @param[in]  system    : Sistema contenente la soluzione
+         * @param[in]  var       : Indice della variabile
+         * @param[in]  side      : Lato di bordo
+         * @param[out] gradients : gradienti della variabile, uno per nodo di quadratura
+         *
+         */
+        void faceGradients(const System &, const unsigned int &, const BoundaryQuadratureCache::Side &, std::vector<Gradient> &) const;
+        
+        /**
+         * @brief Calcola il gradiente di una variabile in un punto di un elemento a partire dai gradi di libertà locali
+         * @param[in] system          : Sistema contenente la soluzione
+         * @param[in] var             : Indice della variabile
+         * @param[in] elem            : Elemento che contiene il punto
+         * @param[in] reference_point : Coordinate del punto nell'elemento di riferimento
+         * @return il gradiente della variabile nel punto
+         *
+         */
+        Gradient elementGradient(const System &, const unsigned int &, const Elem *, const Point &) const;
+        
+        /**
+         * @brief Assembla e risolve un sistema con il risolutore selezionato
+         * @param[in,out] system    : sistema da risolvere, con l'oggetto di assemblaggio già associato
+         * @param[in]     symmetric : vero se la matrice del sistema è simmetrica
+         *
+         * I risolutori iterativi partono dall'ultima soluzione calcolata per lo stesso sistema.
+         *
+         */
+        void solveSystem(LinearImplicitSystem &, const bool &) const;
+        
+        /**
+         * @brief Risolve un sistema che ha la stessa matrice, vincoli compresi, di un sistema già risolto
+         * @param[in,out] system : sistema da risolvere, il cui oggetto di assemblaggio calcola soltanto il termine noto
+         * @param[in]     shared : sistema già risolto di cui riutilizzare matrice e fattorizzazione o precondizionatore
+         *
+         */
+        void solveSystem(LinearImplicitSystem &, LinearImplicitSystem &) const;
+        
+        /**
+         * @brief Risolve un sistema con un operatore matrix-free, senza assemblarne la matrice
+         * @param[in,out] system : sistema esplicito da risolvere, privo di matrice, il cui oggetto di assemblaggio calcola soltanto il termine noto
+         * @param[in]     solver : risolutore lineare del sistema, già configurato
+         * @param[in]     shell  : operatore del sistema, già aggiornato sulla mesh corrente
+         *
+         */
+        void solveSystem(ExplicitSystem &, LinearSolver<Number> &, const ShellMatrix<Number> &) const;
+        
+        /**
+         * @brief Copia nella soluzione del sistema l'ultima soluzione calcolata per lo stesso sistema, se presente
+         * @param[in,out] system : sistema da risolvere
+         *
+         */
+        void loadInitialGuess(System &) const;
+        
+        /**
+         * @brief Memorizza la soluzione del sistema, da usare come dato iniziale alla risoluzione successiva
+         * @param[in] system : sistema appena risolto
+         *
+         */
+        void storeInitialGuess(const System &) const;
+        
+        /**
+         * @brief Calcola l'estensione armonica con il laplaciano scalare fattorizzato sulla mesh di riferimento
+         * @param[in,out] system        : sistema della perturbazione, già inizializzato, in cui scrivere la soluzione
+         * @param[in]     stateAdj      : Sistema d'equazioni contenente stato e aggiunto
+         * @param[in]     lagrange      : lagrangiano
+         * @param[in]     dirichlet_ids : bordi su cui la perturbazione è nulla
+         * @param[in]     traction_ids  : bordi su cui viene applicato il gradiente di forma
+         *
+         * Il laplaciano viene assemblato alla prima chiamata, quando la mesh non è ancora stata deformata;
+         * successivamente viene ricalcolato soltanto il termine noto di bordo.
+         *
+         */
+        void referenceExtension(LinearImplicitSystem &, EquationSystems &, const Real &, const std::set<boundary_id_type> &, const std::set<boundary_id_type> &) const;
+        
         std::shared_ptr<Mesh> mesh_; /**< @brief puntatore alla mesh su cui è definito il problema */
         
         std::string name_;           /**< @brief nome del problema che si vuole risolvere */
+        
+        mutable BoundaryQuadratureCache boundary_cache_;    /**< @brief dati di quadratura sul bordo della mesh corrente */
+        mutable BoundaryQuadratureCache functional_cache_;  /**< @brief dati di quadratura sul bordo della mesh corrente, con la formula del primo ordine dei funzionali */
+        
+        bool direct_solver_;                                        /**< @brief vero se i sistemi lineari vengono risolti con DirectSolver */
+        mutable std::map<std::string, std::shared_ptr<DirectSolver> > direct_solvers_;  /**< @brief risolutori diretti, uno per ogni sistema, che conservano l'analisi simbolica */
+        mutable std::map<std::string, std::vector<Number> > initial_guesses_;            /**< @brief ultima soluzione di ogni sistema, usata come dato iniziale dei risolutori iterativi */
+        
+        bool reference_extension_;                          /**< @brief vero se l'estensione armonica usa il laplaciano della mesh di riferimento */
+        mutable ReferenceLaplacian reference_laplacian_;    /**< @brief laplaciano scalare fattorizzato sulla mesh di riferimento */
 };
 
 inline std::shared_ptr<Mesh> Problem::get_mesh() const
@@ -1,99 +1,191 @@
 #include "ProblemElasticity.h"
 
 ProblemElasticity::ProblemElasticity(Mesh mesh, const Real & lambda, const Real & mu)
-    : Problem(mesh), coeff_lambda_(lambda), coeff_mu_(mu)
+    : Problem(mesh), coeff_lambda_(lambda), coeff_mu_(mu), matrix_free_(false), quadrature_cost_(false)
 {
     name_ = "Elasticity";
 }
 
 void ProblemElasticity::resolveStateAndAdjointEquation(EquationSystems & stateAdj, const Index & n) const
 {
-    LinearImplicitSystem & system = stateAdj.add_system<LinearImplicitSystem> (name_);
-    unsigned int u_var = system.add_variable("u", SECOND, LAGRANGE);
-    unsigned int v_var = system.add_variable("v", SECOND, LAGRANGE);
-    
-    LinearSolver<Real> * linearSolver = system.get_linear_solver();
-    linearSolver->set_solver_type(CG);
+    // Systems, variables and boundary conditions are set up only the first time:
+    // they depend on the mesh connectivity, which is not changed by the deformation.
+    if ( !stateAdj.has_system(name_) )
+    {
+        // The matrix-free state is an explicit system: it has no matrix, and is solved with a solver of its own.
+        ExplicitSystem & system = isMatrixFree() ? stateAdj.add_system<ExplicitSystem> (name_) : stateAdj.add_system<LinearImplicitSystem> (name_);
+        unsigned int u_var = system.add_variable("u", SECOND, LAGRANGE);
+        unsigned int v_var = system.add_variable("v", SECOND, LAGRANGE);
+        
+        if ( isMatrixFree() )
+        {
+            linear_solver_.reset(LinearSolver<Number>::build(mesh_->comm()).release());
+            linear_solver_->set_solver_type(CG);
+            linear_solver_->set_preconditioner_type(JACOBI_PRECOND);
+        }
+        else
+        {
+            stateAdj.get_system<LinearImplicitSystem>(name_).get_linear_solver()->set_solver_type(CG);
+        }
+        
+        std::set<boundary_id_type> boundary_ids;
+        boundary_ids.insert(3);
+        boundary_ids.insert(5);
+        
+        std::vector<unsigned int> variables(2);
+        variables[0] = u_var;
+        variables[1] = v_var;
+        
+        ZeroFunction<> zf;
+        DirichletBoundary dirichlet_bc(boundary_ids, variables, &zf);
+        
+        stateAdj.get_system(name_).get_dof_map().add_dirichlet_boundary(dirichlet_bc);
+        
+        stateAdj.init();
+    }
     
     ElasticityState assState(stateAdj, *this);
     stateAdj.get_system(name_).attach_assemble_object(assState);
     
-    std::set<boundary_id_type> boundary_ids;
-    boundary_ids.insert(3);
-    boundary_ids.insert(5);
-    
-    std::vector<unsigned int> variables(2);
-    variables[0] = u_var;
-    variables[1] = v_var;
-    
-    ZeroFunction<> zf;
-    DirichletBoundary dirichlet_bc(boundary_ids, variables, &zf);
-    
-    stateAdj.get_system(name_).get_dof_map().add_dirichlet_boundary(dirichlet_bc);
+    std::cout << "Solving the State Equation." << std::endl;
     
-    stateAdj.init();
+    if ( isMatrixFree() )
+    {
+        ExplicitSystem & state = stateAdj.get_system<ExplicitSystem>(name_);
+        
+        if ( !operator_ )
+        {
+            operator_ = std::make_shared<ElasticityOperator>(mesh_->comm(), coeff_lambda_, coeff_mu_);
+        }
+        
+        // Only the geometric factors change after a deformation.
+        operator_->update(state);
+        solveSystem(state, *linear_solver_, *operator_);
+    }
+    else
+    {
+        solveSystem(stateAdj.get_system<LinearImplicitSystem>(name_), true);
+    }
     
-    std::cout << "Solving the State Equation." << std::endl;
-    stateAdj.get_system(name_).solve();
     std::cout << "    Done." << std::endl;
 }
 
+void ProblemElasticity::set_matrix_free(const bool & matrix_free)
+{
+    matrix_free_ = matrix_free;
+}
+
+void ProblemElasticity::set_cost_evaluation(const std::string & cost_evaluation)
+{
+    if ( cost_evaluation == "compliance" )
+    {
+        quadrature_cost_ = false;
+    }
+    else if ( cost_evaluation == "quadrature" )
+    {
+        quadrature_cost_ = true;
+    }
+    else
+    {
+        throw std::runtime_error("set_cost_evaluation(): unknown cost evaluation \"" + cost_evaluation + "\".");
+    }
+}
+
+bool ProblemElasticity::isMatrixFree() const
+{
+    return matrix_free_ && !direct_solver_;
+}
+
 Real ProblemElasticity::evaluateCostFunction(EquationSystems & stateAdj) const
 {
-    const MeshBase & mesh = *mesh_;
+    if ( !quadrature_cost_ )
+    {
+        return compliance(stateAdj);
+    }
     
-    FEType fe_type(FIRST, LAGRANGE);
-    AutoPtr<FEBase> fe (FEBase::build(2, fe_type));
-    QGauss qrule (2, fe_type.default_quadrature_order());
-    fe->attach_quadrature_rule (&qrule);
+    const BoundaryQuadratureCache & cache = get_functional_cache(stateAdj.get_mesh());
+    const std::vector<BoundaryQuadratureCache::Side> & sides = cache.get_sides();
     
-    AutoPtr<FEBase> fe_face (FEBase::build(2, fe_type));
-    QGauss qface(1, fe_type.default_quadrature_order());
-    fe_face->attach_quadrature_rule (&qface);
+    const System & system = stateAdj.get_system(name_);
     
     Real sum = 0.0;
     
-    Mesh::const_element_iterator       el     = mesh.active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh.active_local_elements_end();
+    std::vector<Number> values;
     
-    for ( ; el != end_el ; ++el)
+    for (std::size_t s = 0; s < sides.size(); s++)
     {
-        const Elem* elem = *el;
+        const BoundaryQuadratureCache::Side & side = sides[s];
         
-        for (unsigned int s = 0; s < elem->n_sides(); s++)
+        if ( side.has_boundary_id(1) )
         {
-            if (elem->neighbor(s) == NULL)
+            faceValues(system, 1, side, values);
+            
+            for (unsigned int qp = 0; qp < cache.n_points(); qp++)
             {
-                if ( mesh.boundary_info->has_boundary_id (elem, s, 1) )
-                {
-                    const std::vector<std::vector<Real> >&  phi_face = fe_face->get_phi();
-                    const std::vector<Real>& JxW_face = fe_face->get_JxW();
-                    const std::vector<Point> & qface_point = fe_face->get_xyz();
-                    
-                    fe_face->reinit(elem, s);
-                    
-                    for (unsigned int qp = 0; qp < qface.n_points(); qp++)
-                    {
-                        Real value_sol = stateAdj.get_system(name_).point_value(1, qface_point[qp]);
-                        
-                        for (unsigned int i = 0; i < phi_face.size(); i++)
-                        {
-                            sum += std::abs((-1.0) * value_sol * JxW_face[qp] * phi_face[i][qp]);
-                        }
-                    }
-                }
+                Real value_sol = values[qp];
+                
+                sum += std::abs(value_sol) * side.JxW[qp];
             }
         }
     }
     
+    printComplianceCheck(sum, stateAdj);
+    
     return sum;
 }
 
+Real ProblemElasticity::compliance(EquationSystems & stateAdj) const
+{
+    // The load is the only contribution to the right-hand side and the Dirichlet conditions are homogeneous:
+    // the compliance is the work of the load, that is the dot product of the load vector with the solution.
+    const ExplicitSystem & system = stateAdj.get_system<ExplicitSystem>(name_);
+    
+    return system.rhs->dot(*system.solution);
+}
+
+void ProblemElasticity::printComplianceCheck(const Real & cost, EquationSystems & stateAdj) const
+{
+    std::cout << "Cost function: quadrature = " << cost << ", rhs * solution = " << compliance(stateAdj) << std::endl;
+}
+
 Real ProblemElasticity::computeGradient(EquationSystems & stateAdj, const Point & p) const
 {
     Gradient du = stateAdj.get_system(name_).point_gradient(0, p);
     Gradient dv = stateAdj.get_system(name_).point_gradient(1, p);
     
+    return shapeGradient(du, dv);
+}
+
+void ProblemElasticity::computeGradient(EquationSystems & stateAdj, const BoundaryQuadratureCache::Side & side, std::vector<Real> & gradient) const
+{
+    const System & system = stateAdj.get_system(name_);
+    
+    std::vector<Gradient> du;
+    std::vector<Gradient> dv;
+    
+    faceGradients(system, 0, side, du);
+    faceGradients(system, 1, side, dv);
+    
+    gradient.resize(du.size());
+    
+    for (unsigned int qp = 0; qp < gradient.size(); qp++)
+    {
+        gradient[qp] = shapeGradient(du[qp], dv[qp]);
+    }
+}
+
+Real ProblemElasticity::computeGradient(EquationSystems & stateAdj, const Elem * elem, const Point & reference_point) const
+{
+    const System & system = stateAdj.get_system(name_);
+    
+    Gradient du = elementGradient(system, 0, elem, reference_point);
+    Gradient dv = elementGradient(system, 1, elem, reference_point);
+    
+    return shapeGradient(du, dv);
+}
+
+Real ProblemElasticity::shapeGradient(const Gradient & du, const Gradient & dv) const
+{
     Real sum;
     sum = -2. * coeff_mu_ * (
               du(0) * du(0) + dv(1) * dv(1) +
@@ -110,45 +202,26 @@ Real ProblemElasticity::computeGradient(EquationSystems & stateAdj, const Point
 
 Real ProblemElasticity::sqrGradient(EquationSystems & stateAdj) const
 {
-    FEType fe_type(FIRST, LAGRANGE);
-    AutoPtr<FEBase> fe (FEBase::build(2, fe_type));
-    QGauss qrule (2, fe_type.default_quadrature_order());
-    fe->attach_quadrature_rule (&qrule);
-    
-    AutoPtr<FEBase> fe_face (FEBase::build(2, fe_type));
-    QGauss qface(1, fe_type.default_quadrature_order());
-    fe_face->attach_quadrature_rule (&qface);
-    
-    const MeshBase & mesh = stateAdj.get_mesh();
-    
-    Mesh::const_element_iterator       el     = mesh.active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh.active_local_elements_end();
+    const BoundaryQuadratureCache & cache = get_functional_cache(stateAdj.get_mesh());
+    const std::vector<BoundaryQuadratureCache::Side> & sides = cache.get_sides();
     
     Real gradJ2 = 0.0;
     
-    for ( ; el != end_el ; ++el)
+    std::vector<Real> gradient;
+    
+    for (std::size_t s = 0; s < sides.size(); s++)
     {
-        const Elem* elem = *el;
+        const BoundaryQuadratureCache::Side & side = sides[s];
         
-        for (unsigned int s = 0; s < elem->n_sides(); s++)
+        computeGradient(stateAdj, side, gradient);
+        
+        for (unsigned int qp = 0; qp < cache.n_points(); qp++)
         {
-            if (elem->neighbor(s) == NULL)
+            Real g = - gradient[qp];
+            
+            for (unsigned int i = 0; i < side.phi.size(); i++)
             {
-                const std::vector<std::vector<Real> >&  phi_face = fe_face->get_phi();
-                const std::vector<Real>& JxW_face = fe_face->get_JxW();
-                const std::vector<Point> & qface_point = fe_face->get_xyz();
-                
-                fe_face->reinit(elem, s);
-                
-                for (unsigned int qp = 0; qp < qface.n_points(); qp++)
-                {
-                    Real g = - computeGradient(stateAdj, qface_point[qp]);
-                    
-                    for (unsigned int i = 0; i < phi_face.size(); i++)
-                    {
-                        gradJ2 += g * g * JxW_face[qp] * phi_face[i][qp];
-                    }
-                }
+                gradJ2 += g * g * side.JxW[qp] * side.phi[i][qp];
             }
         }
     }
@@ -158,32 +231,48 @@ Real ProblemElasticity::sqrGradient(EquationSystems & stateAdj) const
 
 void ProblemElasticity::harmonicExtension(EquationSystems & perturbation, EquationSystems & stateAdj, const Real & lagrange) const
 {
-    LinearImplicitSystem & system = perturbation.add_system<LinearImplicitSystem> ("Perturbation");
-    unsigned int u_var = system.add_variable("u", SECOND, LAGRANGE);
-    unsigned int v_var = system.add_variable("v", SECOND, LAGRANGE);
-    
-    LinearSolver<Real> * linearSolver = system.get_linear_solver();
-    linearSolver->set_solver_type(CG);
-    
-    ElasticityHE assPerturbation(perturbation, stateAdj, lagrange, *this);
-    perturbation.get_system("Perturbation").attach_assemble_object(assPerturbation);
-    
     std::set<boundary_id_type> boundary_ids;
     boundary_ids.insert(1);
     boundary_ids.insert(3);
     boundary_ids.insert(5);
     
-    std::vector<unsigned int> variables(2);
-    variables[0] = u_var;
-    variables[1] = v_var;
+    if ( !perturbation.has_system("Perturbation") )
+    {
+        LinearImplicitSystem & system = perturbation.add_system<LinearImplicitSystem> ("Perturbation");
+        unsigned int u_var = system.add_variable("u", SECOND, LAGRANGE);
+        unsigned int v_var = system.add_variable("v", SECOND, LAGRANGE);
+        
+        LinearSolver<Real> * linearSolver = system.get_linear_solver();
+        linearSolver->set_solver_type(CG);
+        
+        std::vector<unsigned int> variables(2);
+        variables[0] = u_var;
+        variables[1] = v_var;
+        
+        ZeroFunction<> zf;
+        DirichletBoundary dirichlet_bc(boundary_ids, variables, &zf);
+        
+        perturbation.get_system("Perturbation").get_dof_map().add_dirichlet_boundary(dirichlet_bc);
+        
+        perturbation.init();
+    }
     
-    ZeroFunction<> zf;
-    DirichletBoundary dirichlet_bc(boundary_ids, variables, &zf);
+    // Both components on the scalar Laplacian of the reference mesh, factored once.
+    if ( reference_extension_ )
+    {
+        std::set<boundary_id_type> traction_ids;
+        traction_ids.insert(0);
+        traction_ids.insert(2);
+        traction_ids.insert(4);
+        
+        referenceExtension(perturbation.get_system<LinearImplicitSystem>("Perturbation"), stateAdj, lagrange, boundary_ids, traction_ids);
+        return;
+    }
     
-    perturbation.get_system("Perturbation").get_dof_map().add_dirichlet_boundary(dirichlet_bc);
+    ElasticityHE assPerturbation(perturbation, stateAdj, lagrange, *this);
+    perturbation.get_system("Perturbation").attach_assemble_object(assPerturbation);
     
-    perturbation.init();
-    perturbation.get_system("Perturbation").solve();
+    solveSystem(perturbation.get_system<LinearImplicitSystem>("Perturbation"), true);
 }
 
 bool ProblemElasticity::toBeMoved(const Node &) const
@@ -210,58 +299,107 @@ void ProblemElasticity::fixCP(const MatrixXp & CP_grid, MatrixXp & mu) const
 
 Real ProblemElasticity::lagrangeMult(EquationSystems & stateAdj) const
 {
-    FEType fe_type(FIRST, LAGRANGE);
-    AutoPtr<FEBase> fe (FEBase::build(2, fe_type));
-    QGauss qrule (2, fe_type.default_quadrature_order());
-    fe->attach_quadrature_rule (&qrule);
+    const BoundaryQuadratureCache & cache = get_functional_cache(stateAdj.get_mesh());
+    const std::vector<BoundaryQuadratureCache::Side> & sides = cache.get_sides();
     
-    AutoPtr<FEBase> fe_face (FEBase::build(2, fe_type));
-    QGauss qface(1, fe_type.default_quadrature_order());
-    fe_face->attach_quadrature_rule (&qface);
+    Real num = 0.0;
+    Real den = 0.0;
+    
+    std::vector<Real> gradient;
+    
+    for (std::size_t s = 0; s < sides.size(); s++)
+    {
+        const BoundaryQuadratureCache::Side & side = sides[s];
+        
+        computeGradient(stateAdj, side, gradient);
+        
+        for (unsigned int qp = 0; qp < cache.n_points(); qp++)
+        {
+            Real f = - gradient[qp];
+            
+            for (unsigned int i = 0; i < side.phi.size(); i++)
+            {
+                num += f * side.JxW[qp] * side.phi[i][qp];
+                den +=     side.JxW[qp] * side.phi[i][qp];
+            }
+        }
+    }
     
-    const MeshBase & mesh = *mesh_;
+    return (num / den);
+}
+
+BoundaryFunctionals ProblemElasticity::evaluateBoundaryFunctionals(EquationSystems & stateAdj) const
+{
+    const BoundaryQuadratureCache & cache = get_functional_cache(stateAdj.get_mesh());
+    const std::vector<BoundaryQuadratureCache::Side> & sides = cache.get_sides();
     
-    Mesh::const_element_iterator       el     = mesh.active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh.active_local_elements_end();
+    const System & system = stateAdj.get_system(name_);
     
+    Real cost = 0.0;
+    Real gradJ2 = 0.0;
     Real num = 0.0;
     Real den = 0.0;
     
-    for ( ; el != end_el ; ++el)
+    std::vector<Real> gradient;
+    std::vector<Number> values;
+    
+    // Lagrange shape functions sum up to one: the sums over phi_face in sqrGradient and lagrangeMult reduce to JxW.
+    for (std::size_t s = 0; s < sides.size(); s++)
     {
-        const Elem* elem = *el;
+        const BoundaryQuadratureCache::Side & side = sides[s];
+        const bool load = side.has_boundary_id(1);
+        
+        computeGradient(stateAdj, side, gradient);
+        
+        if ( load && quadrature_cost_ )
+        {
+            faceValues(system, 1, side, values);
+        }
         
-        for (unsigned int s = 0; s < elem->n_sides(); s++)
+        for (unsigned int qp = 0; qp < cache.n_points(); qp++)
         {
-            if (elem->neighbor(s) == NULL)
+            Real f = - gradient[qp];
+            
+            gradJ2 += f * f * side.JxW[qp];
+            num    += f *     side.JxW[qp];
+            den    +=         side.JxW[qp];
+            
+            if ( load && quadrature_cost_ )
             {
-                const std::vector<std::vector<Real> >&  phi_face = fe_face->get_phi();
-                const std::vector<Real>& JxW_face = fe_face->get_JxW();
-                const std::vector<Point> & qface_point = fe_face->get_xyz();
-                
-                fe_face->reinit(elem, s);
-                
-                for (unsigned int qp = 0; qp < qface.n_points(); qp++)
-                {
-                    Real f = - computeGradient(stateAdj, qface_point[qp]);
-                    
-                    for (unsigned int i = 0; i < phi_face.size(); i++)
-                    {
-                        num += f * JxW_face[qp] * phi_face[i][qp];
-                        den +=     JxW_face[qp] * phi_face[i][qp];
-                    }
-                }
+                cost += std::abs(values[qp]) * side.JxW[qp];
             }
         }
     }
     
-    return (num / den);
+    if ( quadrature_cost_ )
+    {
+        printComplianceCheck(cost, stateAdj);
+    }
+    else
+    {
+        cost = compliance(stateAdj);
+    }
+    
+    BoundaryFunctionals functionals;
+    functionals.cost     = cost;
+    functionals.gradJ2   = gradJ2;
+    functionals.lagrange = num / den;
+    
+    return functionals;
 }
 
 ElasticityHE::ElasticityHE(EquationSystems & perturbation, EquationSystems & stateAdj, const Real & lagrange, const ProblemElasticity & problem)
     : perturbation_(perturbation), stateAdj_(stateAdj), lagrange_(lagrange), problem_(problem) {}
 
 void ElasticityHE::assemble()
+{
+    // The boundary quadrature data are built before spawning the threads, which only read them.
+    problem_.get_boundary_cache(stateAdj_.get_mesh());
+    
+    problem_.assembleInThreads(perturbation_.get_system<LinearImplicitSystem>("Perturbation"), [this](const ConstElemRange & range, AssemblyBuffer & buffer) { assembleRange(range, buffer); });
+}
+
+void ElasticityHE::assembleRange(const ConstElemRange & range, AssemblyBuffer & buffer)
 {
     const MeshBase & mesh = perturbation_.get_mesh();
     const unsigned int dim = mesh.mesh_dimension();
@@ -276,9 +414,7 @@ void ElasticityHE::assemble()
     QGauss qrule (dim, fe_type.default_quadrature_order());
     fe->attach_quadrature_rule (&qrule);
     
-    AutoPtr<FEBase> fe_face (FEBase::build(dim, fe_type));
-    QGauss qface(dim - 1, fe_type.default_quadrature_order());
-    fe_face->attach_quadrature_rule (&qface);
+    const BoundaryQuadratureCache & cache = problem_.get_boundary_cache(stateAdj_.get_mesh());
     
     const std::vector<Real>& JxW = fe->get_JxW();
     const std::vector<std::vector<RealGradient> >& dphi = fe->get_dphi();
@@ -293,10 +429,9 @@ void ElasticityHE::assemble()
     std::vector<dof_id_type> dof_indices_u;
     std::vector<dof_id_type> dof_indices_v;
     
-    MeshBase::const_element_iterator       el     = mesh.active_local_elements_begin();
-    const MeshBase::const_element_iterator end_el = mesh.active_local_elements_end();
+    std::vector<Real> gradient;
     
-    for ( ; el != end_el; ++el)
+    for (ConstElemRange::const_iterator el = range.begin(); el != range.end(); ++el)
     {
         const Elem* elem = *el;
         dof_map.dof_indices (elem, dof_indices);
@@ -340,31 +475,28 @@ void ElasticityHE::assemble()
             }
         }
         
-        for (unsigned int side = 0; side < elem->n_sides(); side++)
+        const std::pair<Index, Index> sides_range = cache.get_sides(elem->id());
+        
+        for (Index s = sides_range.first; s < sides_range.second; s++)
         {
-            if (elem->neighbor(side) == NULL)
+            const BoundaryQuadratureCache::Side & side = cache.get_sides()[s];
+            
+            if ( side.has_boundary_id(0) || side.has_boundary_id(2) || side.has_boundary_id(4) ) // Apply a traction on the right side
             {
-                const std::vector<std::vector<Real> >&  phi_face = fe_face->get_phi();
-                const std::vector<Real>& JxW_face = fe_face->get_JxW();
-                const std::vector<Point>& face_normals = fe_face->get_normals();
-                const std::vector<Point> & qface_point = fe_face->get_xyz();
-                fe_face->reinit(elem, side);
+                problem_.computeGradient(stateAdj_, side, gradient);
                 
-                if ( mesh.boundary_info->has_boundary_id (elem, side, 0) || mesh.boundary_info->has_boundary_id (elem, side, 2) || mesh.boundary_info->has_boundary_id (elem, side, 4) ) // Apply a traction on the right side
+                for (unsigned int qp = 0; qp < cache.n_points(); qp++)
                 {
-                    for (unsigned int qp = 0; qp < qface.n_points(); qp++)
+                    Real g = - gradient[qp] - lagrange_;
+                    
+                    for (unsigned int i = 0; i < n_u_dofs; i++)
                     {
-                        Real g = - problem_.computeGradient(stateAdj_, qface_point[qp]) - lagrange_;
-                        
-                        for (unsigned int i = 0; i < n_u_dofs; i++)
-                        {
-                            Fu(i) += g * JxW_face[qp] * face_normals[qp](0) * phi_face[i][qp];
-                        }
-                        
-                        for (unsigned int i = 0; i < n_v_dofs; i++)
-                        {
-                            Fv(i) += g * JxW_face[qp] * face_normals[qp](1) * phi_face[i][qp];
-                        }
+                        Fu(i) += g * side.JxW[qp] * side.normals[qp](0) * side.phi[i][qp];
+                    }
+                    
+                    for (unsigned int i = 0; i < n_v_dofs; i++)
+                    {
+                        Fv(i) += g * side.JxW[qp] * side.normals[qp](1) * side.phi[i][qp];
                     }
                 }
             }
@@ -372,8 +504,7 @@ void ElasticityHE::assemble()
         
         dof_map.constrain_element_matrix_and_vector (Ke, Fe, dof_indices);
         
-        system.matrix->add_matrix (Ke, dof_indices);
-        system.rhs->add_vector    (Fe, dof_indices);
+        buffer.add (Ke, Fe, dof_indices);
     }
 }
 
@@ -381,10 +512,18 @@ ElasticityState::ElasticityState(EquationSystems & stateAdj, const ProblemElasti
     : stateAdj_(stateAdj), problem_(problem) {}
 
 void ElasticityState::assemble()
+{
+    // The boundary quadrature data are built before spawning the threads, which only read them.
+    problem_.get_boundary_cache(stateAdj_.get_mesh());
+    
+    problem_.assembleInThreads(stateAdj_.get_system<ExplicitSystem>(problem_.name_), [this](const ConstElemRange & range, AssemblyBuffer & buffer) { assembleRange(range, buffer); });
+}
+
+void ElasticityState::assembleRange(const ConstElemRange & range, AssemblyBuffer & buffer)
 {
     const MeshBase & mesh = stateAdj_.get_mesh();
     const unsigned int dim = mesh.mesh_dimension();
-    LinearImplicitSystem & system = stateAdj_.get_system<LinearImplicitSystem>(problem_.name_);
+    const ExplicitSystem & system = stateAdj_.get_system<ExplicitSystem>(problem_.name_);
     
     const unsigned int u_var = system.variable_number ("u");
     const unsigned int v_var = system.variable_number ("v");
@@ -395,9 +534,7 @@ void ElasticityState::assemble()
     QGauss qrule (dim, fe_type.default_quadrature_order());
     fe->attach_quadrature_rule (&qrule);
     
-    AutoPtr<FEBase> fe_face (FEBase::build(dim, fe_type));
-    QGauss qface(dim - 1, fe_type.default_quadrature_order());
-    fe_face->attach_quadrature_rule (&qface);
+    const BoundaryQuadratureCache & cache = problem_.get_boundary_cache(mesh);
     
     const std::vector<Real>& JxW = fe->get_JxW();
     const std::vector<std::vector<RealGradient> >& dphi = fe->get_dphi();
@@ -412,10 +549,11 @@ void ElasticityState::assemble()
     std::vector<dof_id_type> dof_indices_u;
     std::vector<dof_id_type> dof_indices_v;
     
-    MeshBase::const_element_iterator       el     = mesh.active_local_elements_begin();
-    const MeshBase::const_element_iterator end_el = mesh.active_local_elements_end();
+    // Fixed-size kernel for the quadratic triangles, the elements of the meshes used by the optimization.
+    ElasticityKernelTri6 kernel(problem_.coeff_lambda_, problem_.coeff_mu_);
+    ElasticityKernelTri6::MatrixK K;
     
-    for ( ; el != end_el; ++el)
+    for (ConstElemRange::const_iterator el = range.begin(); el != range.end(); ++el)
     {
         const Elem* elem = *el;
         dof_map.dof_indices (elem, dof_indices);
@@ -440,123 +578,144 @@ void ElasticityState::assemble()
         Fu.reposition (u_var * n_u_dofs, n_u_dofs);
         Fv.reposition (v_var * n_u_dofs, n_v_dofs);
         
-        for (unsigned int qp = 0; qp < qrule.n_points(); qp++)
+        if ( problem_.isMatrixFree() )
+        {
+            // Only the load is assembled: the stiffness is applied by ElasticityOperator.
+        }
+        else if ( dim == 2 && elem->type() == TRI6 && n_u_dofs == 6 )
         {
-            for (unsigned int i = 0; i < n_u_dofs; i++)
+            K.setZero();
+            
+            for (unsigned int qp = 0; qp < qrule.n_points(); qp++)
             {
-                for (unsigned int j = 0; j < n_u_dofs; j++)
-                {
-                    unsigned int Ci, Cj, Ck, Cl;
-                    Ci = 0, Ck = 0;
-                    
-                    Cj = 0, Cl = 0;
-                    Kuu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 1, Cl = 0;
-                    Kuu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 0, Cl = 1;
-                    Kuu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 1, Cl = 1;
-                    Kuu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                }
+                kernel.addQuadraturePoint(dphi, qp, JxW[qp], K);
             }
             
-            for (unsigned int i = 0; i < n_u_dofs; i++)
+            ElasticityKernelTri6::copy(K, Ke);
+        }
+        else
+        {
+            for (unsigned int qp = 0; qp < qrule.n_points(); qp++)
             {
-                for (unsigned int j = 0; j < n_v_dofs; j++)
+                for (unsigned int i = 0; i < n_u_dofs; i++)
                 {
-                    unsigned int Ci, Cj, Ck, Cl;
-                    Ci = 0, Ck = 1;
-                    
-                    
-                    Cj = 0, Cl = 0;
-                    Kuv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 1, Cl = 0;
-                    Kuv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 0, Cl = 1;
-                    Kuv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 1, Cl = 1;
-                    Kuv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                    for (unsigned int j = 0; j < n_u_dofs; j++)
+                    {
+                        unsigned int Ci, Cj, Ck, Cl;
+                        Ci = 0, Ck = 0;
+                        
+                        Cj = 0, Cl = 0;
+                        Kuu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 1, Cl = 0;
+                        Kuu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 0, Cl = 1;
+                        Kuu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 1, Cl = 1;
+                        Kuu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                    }
                 }
-            }
-            
-            for (unsigned int i = 0; i < n_v_dofs; i++)
-            {
-                for (unsigned int j = 0; j < n_u_dofs; j++)
+                
+                for (unsigned int i = 0; i < n_u_dofs; i++)
                 {
-                    unsigned int Ci, Cj, Ck, Cl;
-                    Ci = 1, Ck = 0;
-                    
-                    
-                    Cj = 0, Cl = 0;
-                    Kvu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 1, Cl = 0;
-                    Kvu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 0, Cl = 1;
-                    Kvu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 1, Cl = 1;
-                    Kvu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                    for (unsigned int j = 0; j < n_v_dofs; j++)
+                    {
+                        unsigned int Ci, Cj, Ck, Cl;
+                        Ci = 0, Ck = 1;
+                        
+                        
+                        Cj = 0, Cl = 0;
+                        Kuv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 1, Cl = 0;
+                        Kuv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 0, Cl = 1;
+                        Kuv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 1, Cl = 1;
+                        Kuv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                    }
                 }
-            }
-            
-            for (unsigned int i = 0; i < n_v_dofs; i++)
-            {
-                for (unsigned int j = 0; j < n_v_dofs; j++)
+                
+                for (unsigned int i = 0; i < n_v_dofs; i++)
                 {
-                    unsigned int Ci, Cj, Ck, Cl;
-                    Ci = 1, Ck = 1;
-                    
-                    
-                    Cj = 0, Cl = 0;
-                    Kvv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 1, Cl = 0;
-                    Kvv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 0, Cl = 1;
-                    Kvv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
-                    
-                    Cj = 1, Cl = 1;
-                    Kvv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                    for (unsigned int j = 0; j < n_u_dofs; j++)
+                    {
+                        unsigned int Ci, Cj, Ck, Cl;
+                        Ci = 1, Ck = 0;
+                        
+                        
+                        Cj = 0, Cl = 0;
+                        Kvu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 1, Cl = 0;
+                        Kvu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 0, Cl = 1;
+                        Kvu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 1, Cl = 1;
+                        Kvu(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                    }
+                }
+                
+                for (unsigned int i = 0; i < n_v_dofs; i++)
+                {
+                    for (unsigned int j = 0; j < n_v_dofs; j++)
+                    {
+                        unsigned int Ci, Cj, Ck, Cl;
+                        Ci = 1, Ck = 1;
+                        
+                        
+                        Cj = 0, Cl = 0;
+                        Kvv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 1, Cl = 0;
+                        Kvv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 0, Cl = 1;
+                        Kvv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                        
+                        Cj = 1, Cl = 1;
+                        Kvv(i, j) += JxW[qp] * (evaluateElasticityTensor(Ci, Cj, Ck, Cl) * dphi[i][qp](Cj) * dphi[j][qp](Cl));
+                    }
                 }
             }
         }
         
+        const std::pair<Index, Index> sides_range = cache.get_sides(elem->id());
         
-        for (unsigned int side = 0; side < elem->n_sides(); side++)
+        for (Index s = sides_range.first; s < sides_range.second; s++)
         {
-            if (elem->neighbor(side) == NULL)
+            const BoundaryQuadratureCache::Side & side = cache.get_sides()[s];
+            
+            if ( side.has_boundary_id(1) ) // Apply a traction on the right side
             {
-                const std::vector<std::vector<Real> >&  phi_face = fe_face->get_phi();
-                const std::vector<Real>& JxW_face = fe_face->get_JxW();
-                //const std::vector<Point>& face_normals = fe_face->get_normals();
-                fe_face->reinit(elem, side);
-                
-                if ( mesh.boundary_info->has_boundary_id (elem, side, 1) ) // Apply a traction on the right side
+                for (unsigned int qp = 0; qp < cache.n_points(); qp++)
                 {
-                    for (unsigned int qp = 0; qp < qface.n_points(); qp++)
+                    for (unsigned int i = 0; i < n_v_dofs; i++)
                     {
-                        for (unsigned int i = 0; i < n_v_dofs; i++)
-                        {
-                            Fv(i) += (-1.0) * JxW_face[qp] * phi_face[i][qp];
-                        }
+                        Fv(i) += (-1.0) * side.JxW[qp] * side.phi[i][qp];
                     }
                 }
             }
         }
         
-        dof_map.constrain_element_matrix_and_vector (Ke, Fe, dof_indices);
-        
-        system.matrix->add_matrix (Ke, dof_indices);
-        system.rhs->add_vector    (Fe, dof_indices);
+        if ( problem_.isMatrixFree() )
+        {
+            dof_map.constrain_element_vector (Fe, dof_indices);
+            
+            buffer.add (Fe, dof_indices);
+        }
+        else
+        {
+            dof_map.constrain_element_matrix_and_vector (Ke, Fe, dof_indices);
+            
+            buffer.add (Ke, Fe, dof_indices);
+        }
     }
 }
 
@@ -17,6 +17,8 @@
 #ifndef PROBLEMELASTICITY_H
 #define PROBLEMELASTICITY_H
 
+#include "ElasticityKernel.h"
+#include "ElasticityOperator.h"
 #include "Problem.h"
 /**
  * @class ProblemElasticity
@@ -65,6 +67,12 @@ class ProblemElasticity : public Problem
          */
         virtual Real computeGradient(EquationSystems &, const Point &) const;
         
+        /** @copydoc Problem::computeGradient(EquationSystems &, const BoundaryQuadratureCache::Side &, std::vector<Real> &) const */
+        virtual void computeGradient(EquationSystems &, const BoundaryQuadratureCache::Side &, std::vector<Real> &) const;
+        
+        /** @copydoc Problem::computeGradient(EquationSystems &, const Elem *, const Point &) const */
+        virtual Real computeGradient(EquationSystems &, const Elem *, const Point &) const;
+        
         /**
          * @brief Metodo per calcolare la norma @f$ L^2 @f$ del gradiente
          * @param[in] stateAdj : Sistema d'equazioni che contiene lo stato e l'aggiunto
@@ -82,10 +90,67 @@ class ProblemElasticity : public Problem
         virtual void fixCP(const MatrixXp &, MatrixXp &) const;
         /** @copydoc Problem::lagrangeMult(EquationSystems &) */
         virtual Real lagrangeMult(EquationSystems &) const;
+        /** @copydoc Problem::evaluateBoundaryFunctionals(EquationSystems &) */
+        virtual BoundaryFunctionals evaluateBoundaryFunctionals(EquationSystems &) const;
+        
+        /**
+         * @brief Seleziona l'operatore matrix-free per lo stato, risolto con CG precondizionato con Jacobi
+         * @param[in] matrix_free : vero per applicare la rigidezza elemento per elemento senza assemblarla
+         *
+         * Non ha effetto se è selezionato il risolutore diretto.
+         *
+         */
+        void set_matrix_free(const bool &);
+        
+        /**
+         * @brief Seleziona il calcolo del funzionale costo
+         * @param[in] cost_evaluation : "compliance" per il prodotto scalare tra termine noto assemblato e soluzione;
+         * "quadrature" per l'integrale sul bordo di carico, che stampa anche il valore della compliance come verifica
+         *
+         */
+        void set_cost_evaluation(const std::string &);
         
     protected:
+        /**
+         * @brief Calcola la compliance come prodotto scalare tra il termine noto dello stato e la soluzione
+         * @param[in] stateAdj : Sistema d'equazioni che contiene lo stato, già risolto
+         * @return il lavoro del carico
+         *
+         */
+        Real compliance(EquationSystems &) const;
+        
+        /**
+         * @brief Stampa il funzionale costo calcolato con la quadratura accanto alla compliance
+         * @param[in] cost     : funzionale costo calcolato con la quadratura
+         * @param[in] stateAdj : Sistema d'equazioni che contiene lo stato, già risolto
+         *
+         */
+        void printComplianceCheck(const Real &, EquationSystems &) const;
+        
+        /**
+         * @brief Indica se lo stato viene risolto con l'operatore matrix-free
+         * @return vero se è selezionato l'operatore matrix-free e il risolutore è iterativo
+         *
+         */
+        bool isMatrixFree() const;
+        
+        /**
+         * @brief Calcola il gradiente di forma a partire dai gradienti dello spostamento
+         * @param[in] du : Gradiente della componente @f$ x @f$ dello spostamento
+         * @param[in] dv : Gradiente della componente @f$ y @f$ dello spostamento
+         * @return il valore di @f$ - 2 \mu | \epsilon (u) |^2 - \lambda (tr(\epsilon (u))^2) @f$
+         *
+         */
+        Real shapeGradient(const Gradient &, const Gradient &) const;
+        
         Real coeff_lambda_;   /**< @brief Coefficiente di Lamé @f$ \lambda @f$ */
         Real coeff_mu_;       /**< @brief Coefficiente di Lamé @f$ \mu @f$ */
+        
+        bool matrix_free_;                                              /**< @brief vero se lo stato usa l'operatore matrix-free */
+        mutable std::shared_ptr<ElasticityOperator> operator_;          /**< @brief operatore matrix-free dello stato, che conserva gradi di libertà e geometria */
+        mutable std::shared_ptr<LinearSolver<Number> > linear_solver_;  /**< @brief risolutore lineare dello stato matrix-free, che è un sistema esplicito */
+        
+        bool quadrature_cost_;  /**< @brief vero se il funzionale costo viene integrato sul bordo di carico invece che calcolato come compliance */
 };
 
 /**
@@ -110,6 +175,14 @@ class ElasticityHE : public System::Assembly
         void assemble(); /**< @brief Assembla le matrici e i vettori per calcolare l'estensione armonica nel problema dell'elasticità */
         
     private:
+        /**
+         * @brief Assembla gli elementi di un intervallo, con oggetti FE e matrici elementari propri del thread chiamante
+         * @param[in]  range  : intervallo di elementi
+         * @param[out] buffer : contributi elementari del thread
+         *
+         */
+        void assembleRange(const ConstElemRange &, AssemblyBuffer &);
+        
         EquationSystems & perturbation_; /**< @brief Sistemi d'equazioni per gestire lo spostamento della mesh */
         EquationSystems & stateAdj_;     /**< @brief Sistemi d'equazioni contenente lo stato e l'aggiunto */
         Real lagrange_;                  /**< @brief Moltiplicatore di lagrange */
@@ -147,6 +220,14 @@ class ElasticityState : public System::Assembly
         Real evaluateElasticityTensor(Index i, Index j, Index k, Index l) const;
         
     private:
+        /**
+         * @brief Assembla gli elementi di un intervallo, con oggetti FE e matrici elementari propri del thread chiamante
+         * @param[in]  range  : intervallo di elementi
+         * @param[out] buffer : contributi elementari del thread
+         *
+         */
+        void assembleRange(const ConstElemRange &, AssemblyBuffer &);
+        
         EquationSystems & stateAdj_;    /**< @brief Sistemi d'equazioni contenente lo stato e l'aggiunto */
         
         const ProblemElasticity & problem_; /**< @brief Riferimento costante al problema dell'elasticità */
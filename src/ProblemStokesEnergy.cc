@@ -8,137 +8,166 @@ ProblemStokesEnergy::ProblemStokesEnergy(Mesh mesh, const Real & ux, const Real
 
 void ProblemStokesEnergy::resolveStateAndAdjointEquation(EquationSystems & stateAdj, const Index & n) const
 {
-    /*
-     * Define state problem.
-     */
-    LinearImplicitSystem & stateSystem = stateAdj.add_system<LinearImplicitSystem> (name_);
-    unsigned int u_var = stateSystem.add_variable ("u", SECOND);
-    unsigned int v_var = stateSystem.add_variable ("v", SECOND);
-    stateSystem.add_variable ("p", FIRST);
-    
-    LinearSolver<Real> * linearSolverState = stateSystem.get_linear_solver();
-    linearSolverState->set_solver_type(BICGSTAB);
-    
-    StokesEnergyState assState(stateAdj, *this);
-    stateAdj.get_system(name_).attach_assemble_object(assState);
-    
-    // Inlet.
+    // Systems, variables and boundary conditions are set up only the first time:
+    // they depend on the mesh connectivity, which is not changed by the deformation.
+    if ( !stateAdj.has_system(name_) )
     {
-        std::vector<unsigned int> variables(2);
-        variables[0] = u_var;
-        variables[1] = v_var;
+        /*
+         * Define state problem.
+         */
+        LinearImplicitSystem & stateSystem = stateAdj.add_system<LinearImplicitSystem> (name_);
+        unsigned int u_var = stateSystem.add_variable ("u", SECOND);
+        unsigned int v_var = stateSystem.add_variable ("v", SECOND);
+        stateSystem.add_variable ("p", FIRST);
+        
+        LinearSolver<Real> * linearSolverState = stateSystem.get_linear_solver();
+        linearSolverState->set_solver_type(BICGSTAB);
+        
+        // The blocks of the preconditioner are collected by the state assembly;
+        // the adjoint is solved with the same linear solver, hence with the same preconditioner.
+        if ( !direct_solver_ )
+        {
+            if ( !preconditioner_ )
+            {
+                preconditioner_ = std::make_shared<StokesBlockPreconditioner>(mesh_->comm());
+                preconditioner_->init();
+            }
+            
+            linearSolverState->attach_preconditioner(preconditioner_.get());
+        }
         
-        std::set<boundary_id_type> boundary_ids;
-        boundary_ids.insert(1);
+        // Inlet.
+        {
+            std::vector<unsigned int> variables(2);
+            variables[0] = u_var;
+            variables[1] = v_var;
+            
+            std::set<boundary_id_type> boundary_ids;
+            boundary_ids.insert(1);
+            
+            StokesEnergyBC dirichlet(u_var, v_var, ux_, uy_);
+            
+            DirichletBoundary stateDirichlet_bc(boundary_ids, variables, &dirichlet);
+            stateAdj.get_system(name_).get_dof_map().add_dirichlet_boundary(stateDirichlet_bc);
+        }
         
-        StokesEnergyBC dirichlet(u_var, v_var, ux_, uy_);
+        // Simmetry.
+        {
+            std::vector<unsigned int> variables(1);
+            variables[0] = v_var;
+            
+            std::set<boundary_id_type> boundary_ids;
+            boundary_ids.insert(3);
+            
+            ZeroFunction<> dirichlet;
+            DirichletBoundary stateDirichlet_bc(boundary_ids, variables, &dirichlet);
+            stateAdj.get_system(name_).get_dof_map().add_dirichlet_boundary(stateDirichlet_bc);
+        }
         
-        DirichletBoundary stateDirichlet_bc(boundary_ids, variables, &dirichlet);
-        stateAdj.get_system(name_).get_dof_map().add_dirichlet_boundary(stateDirichlet_bc);
-    }
-    
-    // Simmetry.
-    {
-        std::vector<unsigned int> variables(1);
-        variables[0] = v_var;
+        // No-slip.
+        {
+            std::vector<unsigned int> variables(2);
+            variables[0] = u_var;
+            variables[1] = v_var;
+            
+            std::set<boundary_id_type> boundary_ids;
+            boundary_ids.insert(4);
+            
+            ZeroFunction<> dirichlet;
+            DirichletBoundary stateDirichlet_bc(boundary_ids, variables, &dirichlet);
+            stateAdj.get_system(name_).get_dof_map().add_dirichlet_boundary(stateDirichlet_bc);
+        }
         
-        std::set<boundary_id_type> boundary_ids;
-        boundary_ids.insert(3);
+        /*
+         * Define adjoint problem.
+         */
+        LinearImplicitSystem & adjointSystem = stateAdj.add_system<LinearImplicitSystem> (name_ + "Adjoint");
+        adjointSystem.add_variable ("au", SECOND);
+        adjointSystem.add_variable ("av", SECOND);
+        adjointSystem.add_variable ("ap", FIRST);
         
-        ZeroFunction<> dirichlet;
-        DirichletBoundary stateDirichlet_bc(boundary_ids, variables, &dirichlet);
-        stateAdj.get_system(name_).get_dof_map().add_dirichlet_boundary(stateDirichlet_bc);
-    }
-    
-    // No-slip.
-    {
-        std::vector<unsigned int> variables(2);
-        variables[0] = u_var;
-        variables[1] = v_var;
+        LinearSolver<Real> * linearSolverAdjoint = adjointSystem.get_linear_solver();
+        linearSolverAdjoint->set_solver_type(BICGSTAB);
         
-        std::set<boundary_id_type> boundary_ids;
-        boundary_ids.insert(4);
+        // Inlet and no-slip.
+        {
+            std::vector<unsigned int> variables(2);
+            variables[0] = u_var;
+            variables[1] = v_var;
+            
+            std::set<boundary_id_type> boundary_ids;
+            boundary_ids.insert(1);
+            boundary_ids.insert(4);
+            
+            ZeroFunction<> dirichlet;
+            
+            DirichletBoundary stateDirichlet_bc(boundary_ids, variables, &dirichlet);
+            stateAdj.get_system(name_ + "Adjoint").get_dof_map().add_dirichlet_boundary(stateDirichlet_bc);
+        }
+        
+        // Simmetry.
+        {
+            std::vector<unsigned int> variables(1);
+            variables[0] = v_var;
+            
+            std::set<boundary_id_type> boundary_ids;
+            boundary_ids.insert(3);
+            
+            ZeroFunction<> dirichlet;
+            DirichletBoundary stateDirichlet_bc(boundary_ids, variables, &dirichlet);
+            stateAdj.get_system(name_ + "Adjoint").get_dof_map().add_dirichlet_boundary(stateDirichlet_bc);
+        }
         
-        ZeroFunction<> dirichlet;
-        DirichletBoundary stateDirichlet_bc(boundary_ids, variables, &dirichlet);
-        stateAdj.get_system(name_).get_dof_map().add_dirichlet_boundary(stateDirichlet_bc);
+        // Initialize.
+        stateAdj.init();
     }
     
-    /*
-     * Define adjoint problem.
-     */
-    LinearImplicitSystem & adjointSystem = stateAdj.add_system<LinearImplicitSystem> (name_ + "Adjoint");
-    adjointSystem.add_variable ("au", SECOND);
-    adjointSystem.add_variable ("av", SECOND);
-    adjointSystem.add_variable ("ap", FIRST);
-    
-    LinearSolver<Real> * linearSolverAdjoint = adjointSystem.get_linear_solver();
-    linearSolverAdjoint->set_solver_type(BICGSTAB);
+    StokesEnergyState assState(stateAdj, *this);
+    stateAdj.get_system(name_).attach_assemble_object(assState);
     
     StokesEnergyAdjoint assAdjoint(stateAdj, *this);
     stateAdj.get_system(name_ + "Adjoint").attach_assemble_object(assAdjoint);
     
-    // Inlet and no-slip.
-    {
-        std::vector<unsigned int> variables(2);
-        variables[0] = u_var;
-        variables[1] = v_var;
-        
-        std::set<boundary_id_type> boundary_ids;
-        boundary_ids.insert(1);
-        boundary_ids.insert(4);
-        
-        ZeroFunction<> dirichlet;
-        
-        DirichletBoundary stateDirichlet_bc(boundary_ids, variables, &dirichlet);
-        stateAdj.get_system(name_ + "Adjoint").get_dof_map().add_dirichlet_boundary(stateDirichlet_bc);
-    }
-    
-    // Simmetry.
-    {
-        std::vector<unsigned int> variables(1);
-        variables[0] = v_var;
-        
-        std::set<boundary_id_type> boundary_ids;
-        boundary_ids.insert(3);
-        
-        ZeroFunction<> dirichlet;
-        DirichletBoundary stateDirichlet_bc(boundary_ids, variables, &dirichlet);
-        stateAdj.get_system(name_ + "Adjoint").get_dof_map().add_dirichlet_boundary(stateDirichlet_bc);
-    }
-    
-    // Initialize.
-    stateAdj.init();
-    
     /*
      * Solve the state problem.
      */
     std::cout << "Solving the State Equation." << std::endl;
-    stateAdj.get_system(name_).solve();
+    solveSystem(stateAdj.get_system<LinearImplicitSystem>(name_), false);
     std::cout << "    Done." << std::endl;
     
     /*
      * Solve the adjoint problem.
+     * State and adjoint share the Stokes operator and the constrained DOFs: only the right-hand side is assembled.
      */
     std::cout << "Solving the Adjoint Equation." << std::endl;
-    stateAdj.get_system(name_ + "Adjoint").solve();
+    solveSystem(stateAdj.get_system<LinearImplicitSystem>(name_ + "Adjoint"), stateAdj.get_system<LinearImplicitSystem>(name_));
     std::cout << "    Done." << std::endl;
 }
 
 Real ProblemStokesEnergy::evaluateCostFunction(EquationSystems & stateAdj) const
 {
     const MeshBase & mesh = stateAdj.get_mesh();
+    const unsigned int dim = mesh.mesh_dimension();
+    const System & state = stateAdj.get_system(name_);
+    
+    const unsigned int u_var = state.variable_number ("u");
+    const unsigned int v_var = state.variable_number ("v");
+    
     Mesh::const_element_iterator  el     = mesh.active_local_elements_begin();
     const Mesh::const_element_iterator end_el = mesh.active_local_elements_end();
     
-    FEType fe_type(FIRST, LAGRANGE);
-    AutoPtr<FEBase> fe (FEBase::build(2, fe_type));
-    QGauss qrule (2, fe_type.default_quadrature_order());
+    FEType fe_type = state.variable_type(u_var);
+    AutoPtr<FEBase> fe (FEBase::build(dim, fe_type));
+    QGauss qrule (dim, fe_type.default_quadrature_order());
     fe->attach_quadrature_rule (&qrule);
     
-    const std::vector<std::vector<Real> >&  phi = fe->get_phi();
     const std::vector<Real>& JxW = fe->get_JxW();
-    const std::vector<Point> & xyz = fe->get_xyz();
+    const std::vector<std::vector<RealGradient> >& dphi = fe->get_dphi();
+    
+    const DofMap & dof_map = state.get_dof_map();
+    
+    std::vector<dof_id_type> dof_indices_u;
+    std::vector<dof_id_type> dof_indices_v;
     
     Real sum = 0.0;
     
@@ -146,17 +175,27 @@ Real ProblemStokesEnergy::evaluateCostFunction(EquationSystems & stateAdj) const
     {
         const Elem* elem = *el;
         
+        dof_map.dof_indices (elem, dof_indices_u, u_var);
+        dof_map.dof_indices (elem, dof_indices_v, v_var);
+        
         fe->reinit(elem);
         
         for (unsigned int qp = 0; qp < qrule.n_points(); qp++)
         {
-            Gradient du(stateAdj.get_system(name_).point_gradient(0, xyz[qp]));
-            Gradient dv(stateAdj.get_system(name_).point_gradient(1, xyz[qp]));
+            Gradient du;
+            Gradient dv;
             
-            for (unsigned int i = 0; i < phi.size(); i++)
+            for (unsigned int j = 0; j < dof_indices_u.size(); j++)
             {
-                sum += 0.5 * (du * du + dv * dv) * JxW[qp];
+                du.add_scaled(dphi[j][qp], state.current_solution(dof_indices_u[j]));
             }
+            
+            for (unsigned int j = 0; j < dof_indices_v.size(); j++)
+            {
+                dv.add_scaled(dphi[j][qp], state.current_solution(dof_indices_v[j]));
+            }
+            
+            sum += 0.5 * (du * du + dv * dv) * JxW[qp];
         }
     }
     
@@ -174,47 +213,67 @@ Real ProblemStokesEnergy::computeGradient(EquationSystems & stateAdj, const Poin
     return (du * dau + dv * dav - 0.5 * (du * du + dv * dv));
 }
 
-Real ProblemStokesEnergy::sqrGradient(EquationSystems & stateAdj) const
+void ProblemStokesEnergy::computeGradient(EquationSystems & stateAdj, const BoundaryQuadratureCache::Side & side, std::vector<Real> & gradient) const
 {
-    FEType fe_type(FIRST, LAGRANGE);
-    AutoPtr<FEBase> fe (FEBase::build(2, fe_type));
-    QGauss qrule (2, fe_type.default_quadrature_order());
-    fe->attach_quadrature_rule (&qrule);
+    const System & state   = stateAdj.get_system(name_);
+    const System & adjoint = stateAdj.get_system(name_ + "Adjoint");
     
-    AutoPtr<FEBase> fe_face (FEBase::build(2, fe_type));
-    QGauss qface(1, fe_type.default_quadrature_order());
-    fe_face->attach_quadrature_rule (&qface);
+    std::vector<Gradient> du;
+    std::vector<Gradient> dv;
     
-    const MeshBase & mesh = stateAdj.get_mesh();
+    std::vector<Gradient> dau;
+    std::vector<Gradient> dav;
     
-    Mesh::const_element_iterator       el     = mesh.active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh.active_local_elements_end();
+    faceGradients(state, 0, side, du);
+    faceGradients(state, 1, side, dv);
+    
+    faceGradients(adjoint, 0, side, dau);
+    faceGradients(adjoint, 1, side, dav);
+    
+    gradient.resize(du.size());
+    
+    for (unsigned int qp = 0; qp < gradient.size(); qp++)
+    {
+        gradient[qp] = du[qp] * dau[qp] + dv[qp] * dav[qp] - 0.5 * (du[qp] * du[qp] + dv[qp] * dv[qp]);
+    }
+}
+
+Real ProblemStokesEnergy::computeGradient(EquationSystems & stateAdj, const Elem * elem, const Point & reference_point) const
+{
+    const System & state   = stateAdj.get_system(name_);
+    const System & adjoint = stateAdj.get_system(name_ + "Adjoint");
+    
+    Gradient du = elementGradient(state, 0, elem, reference_point);
+    Gradient dv = elementGradient(state, 1, elem, reference_point);
+    
+    Gradient dau = elementGradient(adjoint, 0, elem, reference_point);
+    Gradient dav = elementGradient(adjoint, 1, elem, reference_point);
+    
+    return (du * dau + dv * dav - 0.5 * (du * du + dv * dv));
+}
+
+Real ProblemStokesEnergy::sqrGradient(EquationSystems & stateAdj) const
+{
+    const BoundaryQuadratureCache & cache = get_functional_cache(stateAdj.get_mesh());
+    const std::vector<BoundaryQuadratureCache::Side> & sides = cache.get_sides();
     
     Real gradJ2 = 0.0;
     
-    for ( ; el != end_el ; ++el)
+    std::vector<Real> gradient;
+    
+    for (std::size_t s = 0; s < sides.size(); s++)
     {
-        const Elem* elem = *el;
+        const BoundaryQuadratureCache::Side & side = sides[s];
+        
+        computeGradient(stateAdj, side, gradient);
         
-        for (unsigned int s = 0; s < elem->n_sides(); s++)
+        for (unsigned int qp = 0; qp < cache.n_points(); qp++)
         {
-            if (elem->neighbor(s) == NULL)
+            Real g = - gradient[qp];
+            
+            for (unsigned int i = 0; i < side.phi.size(); i++)
             {
-                const std::vector<std::vector<Real> >&  phi_face = fe_face->get_phi();
-                const std::vector<Real>& JxW_face = fe_face->get_JxW();
-                const std::vector<Point> & qface_point = fe_face->get_xyz();
-                
-                fe_face->reinit(elem, s);
-                
-                for (unsigned int qp = 0; qp < qface.n_points(); qp++)
-                {
-                    Real g = - computeGradient(stateAdj, qface_point[qp]);
-                    
-                    for (unsigned int i = 0; i < phi_face.size(); i++)
-                    {
-                        gradJ2 += g * g * JxW_face[qp] * phi_face[i][qp];
-                    }
-                }
+                gradJ2 += g * g * side.JxW[qp] * side.phi[i][qp];
             }
         }
     }
@@ -224,32 +283,46 @@ Real ProblemStokesEnergy::sqrGradient(EquationSystems & stateAdj) const
 
 void ProblemStokesEnergy::harmonicExtension(EquationSystems & perturbation, EquationSystems & stateAdj, const Real & lagrange) const
 {
-    LinearImplicitSystem & system = perturbation.add_system<LinearImplicitSystem> ("Perturbation");
-    unsigned int u_var = system.add_variable("u", SECOND, LAGRANGE);
-    unsigned int v_var = system.add_variable("v", SECOND, LAGRANGE);
-    
-    LinearSolver<Real> * linearSolver = system.get_linear_solver();
-    linearSolver->set_solver_type(CG);
-    
-    StokesEnergyHE assPerturbation(perturbation, stateAdj, lagrange, *this);
-    perturbation.get_system("Perturbation").attach_assemble_object(assPerturbation);
-    
     std::set<boundary_id_type> boundary_ids;
     boundary_ids.insert(1);
     boundary_ids.insert(2);
     boundary_ids.insert(3);
     
-    std::vector<unsigned int> variables(2);
-    variables[0] = u_var;
-    variables[1] = v_var;
+    if ( !perturbation.has_system("Perturbation") )
+    {
+        LinearImplicitSystem & system = perturbation.add_system<LinearImplicitSystem> ("Perturbation");
+        unsigned int u_var = system.add_variable("u", SECOND, LAGRANGE);
+        unsigned int v_var = system.add_variable("v", SECOND, LAGRANGE);
+        
+        LinearSolver<Real> * linearSolver = system.get_linear_solver();
+        linearSolver->set_solver_type(CG);
+        
+        std::vector<unsigned int> variables(2);
+        variables[0] = u_var;
+        variables[1] = v_var;
+        
+        ZeroFunction<> zf;
+        DirichletBoundary dirichlet_bc(boundary_ids, variables, &zf);
+        
+        perturbation.get_system("Perturbation").get_dof_map().add_dirichlet_boundary(dirichlet_bc);
+        
+        perturbation.init();
+    }
     
-    ZeroFunction<> zf;
-    DirichletBoundary dirichlet_bc(boundary_ids, variables, &zf);
+    // Both components on the scalar Laplacian of the reference mesh, factored once.
+    if ( reference_extension_ )
+    {
+        std::set<boundary_id_type> traction_ids;
+        traction_ids.insert(4);
+        
+        referenceExtension(perturbation.get_system<LinearImplicitSystem>("Perturbation"), stateAdj, lagrange, boundary_ids, traction_ids);
+        return;
+    }
     
-    perturbation.get_system("Perturbation").get_dof_map().add_dirichlet_boundary(dirichlet_bc);
+    StokesEnergyHE assPerturbation(perturbation, stateAdj, lagrange, *this);
+    perturbation.get_system("Perturbation").attach_assemble_object(assPerturbation);
     
-    perturbation.init();
-    perturbation.get_system("Perturbation").solve();
+    solveSystem(perturbation.get_system<LinearImplicitSystem>("Perturbation"), true);
 }
 
 bool ProblemStokesEnergy::toBeMoved(const Node & node) const
@@ -277,49 +350,30 @@ void ProblemStokesEnergy::fixCP(const MatrixXp & CP_grid, MatrixXp & mu) const
 
 Real ProblemStokesEnergy::lagrangeMult(EquationSystems & stateAdj) const
 {
-    FEType fe_type(FIRST, LAGRANGE);
-    AutoPtr<FEBase> fe (FEBase::build(2, fe_type));
-    QGauss qrule (2, fe_type.default_quadrature_order());
-    fe->attach_quadrature_rule (&qrule);
-    
-    AutoPtr<FEBase> fe_face (FEBase::build(2, fe_type));
-    QGauss qface(1, fe_type.default_quadrature_order());
-    fe_face->attach_quadrature_rule (&qface);
-    
-    const MeshBase & mesh = *mesh_;
-    
-    Mesh::const_element_iterator       el     = mesh.active_local_elements_begin();
-    const Mesh::const_element_iterator end_el = mesh.active_local_elements_end();
+    const BoundaryQuadratureCache & cache = get_functional_cache(stateAdj.get_mesh());
+    const std::vector<BoundaryQuadratureCache::Side> & sides = cache.get_sides();
     
     Real num = 0.0;
     Real den = 0.0;
     
-    for ( ; el != end_el; ++el)
+    std::vector<Real> gradient;
+    
+    for (std::size_t s = 0; s < sides.size(); s++)
     {
-        const Elem* elem = *el;
+        const BoundaryQuadratureCache::Side & side = sides[s];
         
-        for (unsigned int s = 0; s < elem->n_sides(); s++)
+        if ( side.has_boundary_id(4) ) // NACA.
         {
-            if (elem->neighbor(s) == NULL)
+            computeGradient(stateAdj, side, gradient);
+            
+            for (unsigned int qp = 0; qp < cache.n_points(); qp++)
             {
-                const std::vector<std::vector<Real> >&  phi_face = fe_face->get_phi();
-                const std::vector<Real>& JxW_face = fe_face->get_JxW();
-                const std::vector<Point> & qface_point = fe_face->get_xyz();
+                Real f = - gradient[qp];
                 
-                fe_face->reinit(elem, s);
-                
-                if ( mesh.boundary_info->has_boundary_id (elem, s, 4) ) // NACA.
+                for (unsigned int i = 0; i < side.phi.size(); i++)
                 {
-                    for (unsigned int qp = 0; qp < qface.n_points(); qp++)
-                    {
-                        Real f = - computeGradient(stateAdj, qface_point[qp]);
-                        
-                        for (unsigned int i = 0; i < phi_face.size(); i++)
-                        {
-                            num += f * JxW_face[qp] * phi_face[i][qp];
-                            den +=     JxW_face[qp] * phi_face[i][qp];
-                        }
-                    }
+                    num += f * side.JxW[qp] * side.phi[i][qp];
+                    den +=     side.JxW[qp] * side.phi[i][qp];
                 }
             }
         }
@@ -328,12 +382,61 @@ Real ProblemStokesEnergy::lagrangeMult(EquationSystems & stateAdj) const
     return (num / den);
 }
 
+BoundaryFunctionals ProblemStokesEnergy::evaluateBoundaryFunctionals(EquationSystems & stateAdj) const
+{
+    const BoundaryQuadratureCache & cache = get_functional_cache(stateAdj.get_mesh());
+    const std::vector<BoundaryQuadratureCache::Side> & sides = cache.get_sides();
+    
+    Real gradJ2 = 0.0;
+    Real num = 0.0;
+    Real den = 0.0;
+    
+    std::vector<Real> gradient;
+    
+    // Lagrange shape functions sum up to one: the sums over phi_face in sqrGradient and lagrangeMult reduce to JxW.
+    for (std::size_t s = 0; s < sides.size(); s++)
+    {
+        const BoundaryQuadratureCache::Side & side = sides[s];
+        const bool naca = side.has_boundary_id(4);
+        
+        computeGradient(stateAdj, side, gradient);
+        
+        for (unsigned int qp = 0; qp < cache.n_points(); qp++)
+        {
+            Real f = - gradient[qp];
+            
+            gradJ2 += f * f * side.JxW[qp];
+            
+            if ( naca )
+            {
+                num += f * side.JxW[qp];
+                den +=     side.JxW[qp];
+            }
+        }
+    }
+    
+    BoundaryFunctionals functionals;
+    functionals.cost     = evaluateCostFunction(stateAdj); // Volume integral.
+    functionals.gradJ2   = gradJ2;
+    functionals.lagrange = num / den;
+    
+    return functionals;
+}
+
 StokesEnergyHE::StokesEnergyHE(EquationSystems & perturbation, EquationSystems & stateAdj, const Real & lagrange, const ProblemStokesEnergy & problem)
     : perturbation_(perturbation), stateAdj_(stateAdj), lagrange_(lagrange), problem_(problem) {}
 
 void StokesEnergyHE::assemble()
 {
-    const MeshBase & mesh = stateAdj_.get_mesh();
+    // The boundary quadrature data are built before spawning the threads, which only read them.
+    problem_.get_boundary_cache(stateAdj_.get_mesh());
+    
+    problem_.assembleInThreads(perturbation_.get_system<LinearImplicitSystem>("Perturbation"), [this](const ConstElemRange & range, AssemblyBuffer & buffer) { assembleRange(range, buffer); });
+}
+
+void StokesEnergyHE::assembleRange(const ConstElemRange & range, AssemblyBuffer & buffer)
+{
+    const MeshBase & mesh = perturbation_.get_mesh();
     const unsigned int dim = mesh.mesh_dimension();
     LinearImplicitSystem & system = perturbation_.get_system<LinearImplicitSystem>("Perturbation");
     
@@ -346,9 +449,7 @@ void StokesEnergyHE::assemble()
     QGauss qrule (dim, fe_type.default_quadrature_order());
     fe->attach_quadrature_rule (&qrule);
     
-    AutoPtr<FEBase> fe_face (FEBase::build(dim, fe_type));
-    QGauss qface(dim - 1, fe_type.default_quadrature_order());
-    fe_face->attach_quadrature_rule (&qface);
+    const BoundaryQuadratureCache & cache = problem_.get_boundary_cache(stateAdj_.get_mesh());
     
     const std::vector<Real>& JxW = fe->get_JxW();
     const std::vector<std::vector<RealGradient> >& dphi = fe->get_dphi();
@@ -363,10 +464,9 @@ void StokesEnergyHE::assemble()
     std::vector<dof_id_type> dof_indices_u;
     std::vector<dof_id_type> dof_indices_v;
     
-    MeshBase::const_element_iterator       el     = mesh.active_local_elements_begin();
-    const MeshBase::const_element_iterator end_el = mesh.active_local_elements_end();
+    std::vector<Real> gradient;
     
-    for ( ; el != end_el; ++el)
+    for (ConstElemRange::const_iterator el = range.begin(); el != range.end(); ++el)
     {
         const Elem* elem = *el;
         dof_map.dof_indices (elem, dof_indices);
@@ -406,31 +506,29 @@ void StokesEnergyHE::assemble()
                 }
         }
         
-        for (unsigned int side = 0; side < elem->n_sides(); side++)
+        // The perturbation lives on a copy of the state mesh: same element ids, same geometry.
+        const std::pair<Index, Index> sides_range = cache.get_sides(elem->id());
+        
+        for (Index s = sides_range.first; s < sides_range.second; s++)
         {
-            if (elem->neighbor(side) == NULL)
+            const BoundaryQuadratureCache::Side & side = cache.get_sides()[s];
+            
+            if ( side.has_boundary_id(4) ) // NACA.
             {
-                const std::vector<std::vector<Real> >&  phi_face = fe_face->get_phi();
-                const std::vector<Real>& JxW_face = fe_face->get_JxW();
-                const std::vector<Point>& face_normals = fe_face->get_normals();
-                const std::vector<Point> & qface_point = fe_face->get_xyz();
-                fe_face->reinit(elem, side);
+                problem_.computeGradient(stateAdj_, side, gradient);
                 
-                if ( mesh.boundary_info->has_boundary_id (elem, side, 4) ) // NACA.
+                for (unsigned int qp = 0; qp < cache.n_points(); qp++)
                 {
-                    for (unsigned int qp = 0; qp < qface.n_points(); qp++)
+                    Real g = - gradient[qp] - lagrange_;
+                    
+                    for (unsigned int i = 0; i < n_u_dofs; i++)
                     {
-                        Real g = - problem_.computeGradient(stateAdj_, qface_point[qp]) - lagrange_;
-                        
-                        for (unsigned int i = 0; i < n_u_dofs; i++)
-                        {
-                            Fu(i) += g * JxW_face[qp] * face_normals[qp](0) * phi_face[i][qp];
-                        }
-                        
-                        for (unsigned int i = 0; i < n_v_dofs; i++)
-                        {
-                            Fv(i) += g * JxW_face[qp] * face_normals[qp](1) * phi_face[i][qp];
-                        }
+                        Fu(i) += g * side.JxW[qp] * side.normals[qp](0) * side.phi[i][qp];
+                    }
+                    
+                    for (unsigned int i = 0; i < n_v_dofs; i++)
+                    {
+                        Fv(i) += g * side.JxW[qp] * side.normals[qp](1) * side.phi[i][qp];
                     }
                 }
             }
@@ -438,8 +536,7 @@ void StokesEnergyHE::assemble()
         
         dof_map.constrain_element_matrix_and_vector (Ke, Fe, dof_indices);
         
-        system.matrix->add_matrix (Ke, dof_indices);
-        system.rhs->add_vector    (Fe, dof_indices);
+        buffer.add (Ke, Fe, dof_indices);
     }
 }
 
@@ -447,6 +544,27 @@ StokesEnergyState::StokesEnergyState(EquationSystems & stateAdj, const ProblemSt
     : stateAdj_(stateAdj), problem_(problem) {}
 
 void StokesEnergyState::assemble()
+{
+    LinearImplicitSystem & system = stateAdj_.get_system<LinearImplicitSystem>(problem_.name_);
+    
+    if ( !problem_.preconditioner_ )
+    {
+        problem_.assembleInThreads(system, [this](const ConstElemRange & range, AssemblyBuffer & buffer) { assembleRange(range, buffer); });
+        
+        return;
+    }
+    
+    problem_.preconditioner_->begin(system, system.variable_number ("p"));
+    
+    // The blocks of the preconditioner are collected together with the element contributions.
+    problem_.assembleInThreads(system, [this](const ConstElemRange & range, AssemblyBuffer & buffer) { assembleRange(range, buffer); },
+                               [this](const AssemblyBuffer::Contribution & contribution)
+    {
+        problem_.preconditioner_->add(contribution.Ke, contribution.dof_indices, contribution.Me, contribution.dof_indices_aux);
+    });
+}
+
+void StokesEnergyState::assembleRange(const ConstElemRange & range, AssemblyBuffer & buffer)
 {
     const MeshBase & mesh = stateAdj_.get_mesh();
     const unsigned int dim = mesh.mesh_dimension();
@@ -493,11 +611,10 @@ void StokesEnergyState::assemble()
     std::vector<dof_id_type> dof_indices_v;
     std::vector<dof_id_type> dof_indices_p;
     
+    // Pressure mass matrix, used by the preconditioner to approximate the Schur complement.
+    DenseMatrix<Number> Me;
     
-    MeshBase::const_element_iterator       el     = mesh.active_local_elements_begin();
-    const MeshBase::const_element_iterator end_el = mesh.active_local_elements_end();
-    
-    for ( ; el != end_el; ++el)
+    for (ConstElemRange::const_iterator el = range.begin(); el != range.end(); ++el)
     {
         const Elem* elem = *el;
         
@@ -516,6 +633,7 @@ void StokesEnergyState::assemble()
         
         Ke.resize (n_dofs, n_dofs);
         Fe.resize (n_dofs);
+        Me.resize (n_p_dofs, n_p_dofs);
         
         Kuu.reposition (u_var * n_u_dofs, u_var * n_u_dofs, n_u_dofs, n_u_dofs);
         Kuv.reposition (u_var * n_u_dofs, v_var * n_u_dofs, n_u_dofs, n_v_dofs);
@@ -573,12 +691,22 @@ void StokesEnergyState::assemble()
                     Kpv(i, j) += -JxW[qp] * psi[i][qp] * dphi[j][qp](1);
                 }
                 
+            for (unsigned int i = 0; i < n_p_dofs; i++)
+                for (unsigned int j = 0; j < n_p_dofs; j++)
+                {
+                    Me(i, j) += JxW[qp] * psi[i][qp] * psi[j][qp];
+                }
+                
         } // end of the quadrature point qp-loop
         
         dof_map.heterogenously_constrain_element_matrix_and_vector (Ke, Fe, dof_indices);
         
-        system.matrix->add_matrix (Ke, dof_indices);
-        system.rhs->add_vector    (Fe, dof_indices);
+        buffer.add (Ke, Fe, dof_indices);
+        
+        if ( problem_.preconditioner_ )
+        {
+            buffer.addAuxiliary (Me, dof_indices_p);
+        }
     } // end of element loop
     
     return;
@@ -588,6 +716,11 @@ StokesEnergyAdjoint::StokesEnergyAdjoint(EquationSystems & stateAdj, const Probl
     : stateAdj_(stateAdj), problem_(problem) {}
 
 void StokesEnergyAdjoint::assemble()
+{
+    problem_.assembleInThreads(stateAdj_.get_system<LinearImplicitSystem>(problem_.name_ + "Adjoint"), [this](const ConstElemRange & range, AssemblyBuffer & buffer) { assembleRange(range, buffer); });
+}
+
+void StokesEnergyAdjoint::assembleRange(const ConstElemRange & range, AssemblyBuffer & buffer)
 {
     const MeshBase & mesh = stateAdj_.get_mesh();
     const unsigned int dim = mesh.mesh_dimension();
@@ -598,49 +731,42 @@ void StokesEnergyAdjoint::assemble()
     const unsigned int p_var = system.variable_number ("ap");
     
     FEType fe_vel_type = system.variable_type(u_var);
-    FEType fe_pres_type = system.variable_type(p_var);
     
     AutoPtr<FEBase> fe_vel  (FEBase::build(dim, fe_vel_type));
-    AutoPtr<FEBase> fe_pres (FEBase::build(dim, fe_pres_type));
     
     QGauss qrule (dim, fe_vel_type.default_quadrature_order());
     
     fe_vel->attach_quadrature_rule (&qrule);
-    fe_pres->attach_quadrature_rule (&qrule);
-    
-    const std::vector<Point>& xyz = fe_vel->get_xyz();
     
     const std::vector<Real>& JxW = fe_vel->get_JxW();
     
     const std::vector<std::vector<RealGradient> >& dphi = fe_vel->get_dphi();
     
-    const std::vector<std::vector<Real> >& psi = fe_pres->get_phi();
-    
     const DofMap & dof_map = system.get_dof_map();
     
-    DenseMatrix<Number> Ke;
+    // The state velocity has the same finite element type as the adjoint one.
+    const System & state = stateAdj_.get_system(problem_.name_);
+    const DofMap & state_dof_map = state.get_dof_map();
+    
+    const unsigned int state_u_var = state.variable_number ("u");
+    const unsigned int state_v_var = state.variable_number ("v");
+    
     DenseVector<Number> Fe;
     
-    DenseSubMatrix<Number>
-    Kuu(Ke), Kuv(Ke), Kup(Ke),
-        Kvu(Ke), Kvv(Ke), Kvp(Ke),
-        Kpu(Ke), Kpv(Ke), Kpp(Ke);
-        
     DenseSubVector<Number>
     Fu(Fe),
-    Fv(Fe),
-    Fp(Fe);
+    Fv(Fe);
     
     std::vector<dof_id_type> dof_indices;
     std::vector<dof_id_type> dof_indices_u;
     std::vector<dof_id_type> dof_indices_v;
     std::vector<dof_id_type> dof_indices_p;
     
+    std::vector<dof_id_type> state_dof_indices_u;
+    std::vector<dof_id_type> state_dof_indices_v;
     
-    MeshBase::const_element_iterator       el     = mesh.active_local_elements_begin();
-    const MeshBase::const_element_iterator end_el = mesh.active_local_elements_end();
     
-    for ( ; el != end_el; ++el)
+    for (ConstElemRange::const_iterator el = range.begin(); el != range.end(); ++el)
     {
         const Elem* elem = *el;
         
@@ -649,76 +775,34 @@ void StokesEnergyAdjoint::assemble()
         dof_map.dof_indices (elem, dof_indices_v, v_var);
         dof_map.dof_indices (elem, dof_indices_p, p_var);
         
+        state_dof_map.dof_indices (elem, state_dof_indices_u, state_u_var);
+        state_dof_map.dof_indices (elem, state_dof_indices_v, state_v_var);
+        
         const unsigned int n_dofs   = dof_indices.size();
         const unsigned int n_u_dofs = dof_indices_u.size();
         const unsigned int n_v_dofs = dof_indices_v.size();
-        const unsigned int n_p_dofs = dof_indices_p.size();
         
         fe_vel->reinit  (elem);
-        fe_pres->reinit (elem);
         
-        Ke.resize (n_dofs, n_dofs);
         Fe.resize (n_dofs);
         
-        Kuu.reposition (u_var * n_u_dofs, u_var * n_u_dofs, n_u_dofs, n_u_dofs);
-        Kuv.reposition (u_var * n_u_dofs, v_var * n_u_dofs, n_u_dofs, n_v_dofs);
-        Kup.reposition (u_var * n_u_dofs, p_var * n_u_dofs, n_u_dofs, n_p_dofs);
-        
-        Kvu.reposition (v_var * n_v_dofs, u_var * n_v_dofs, n_v_dofs, n_u_dofs);
-        Kvv.reposition (v_var * n_v_dofs, v_var * n_v_dofs, n_v_dofs, n_v_dofs);
-        Kvp.reposition (v_var * n_v_dofs, p_var * n_v_dofs, n_v_dofs, n_p_dofs);
-        
-        Kpu.reposition (p_var * n_u_dofs, u_var * n_u_dofs, n_p_dofs, n_u_dofs);
-        Kpv.reposition (p_var * n_u_dofs, v_var * n_u_dofs, n_p_dofs, n_v_dofs);
-        Kpp.reposition (p_var * n_u_dofs, p_var * n_u_dofs, n_p_dofs, n_p_dofs);
-        
         Fu.reposition (u_var * n_u_dofs, n_u_dofs);
         Fv.reposition (v_var * n_u_dofs, n_v_dofs);
-        Fp.reposition (p_var * n_u_dofs, n_p_dofs);
         
         for (unsigned int qp = 0; qp < qrule.n_points(); qp++)
         {
-            for (unsigned int i = 0; i < n_u_dofs; i++)
-                for (unsigned int j = 0; j < n_u_dofs; j++)
-                {
-                    Kuu(i, j) += JxW[qp] * (dphi[i][qp] * dphi[j][qp]);
-                }
-                
-            for (unsigned int i = 0; i < n_u_dofs; i++)
-                for (unsigned int j = 0; j < n_p_dofs; j++)
-                {
-                    Kup(i, j) += -JxW[qp] * psi[j][qp] * dphi[i][qp](0);
-                }
-                
-                
-            for (unsigned int i = 0; i < n_v_dofs; i++)
-                for (unsigned int j = 0; j < n_v_dofs; j++)
-                {
-                    Kvv(i, j) += JxW[qp] * (dphi[i][qp] * dphi[j][qp]);
-                }
-                
-            for (unsigned int i = 0; i < n_v_dofs; i++)
-                for (unsigned int j = 0; j < n_p_dofs; j++)
-                {
-                    Kvp(i, j) += -JxW[qp] * psi[j][qp] * dphi[i][qp](1);
-                }
-                
-                
-            for (unsigned int i = 0; i < n_p_dofs; i++)
-                for (unsigned int j = 0; j < n_u_dofs; j++)
-                {
-                    Kpu(i, j) += -JxW[qp] * psi[i][qp] * dphi[j][qp](0);
-                }
-                
-            for (unsigned int i = 0; i < n_p_dofs; i++)
-                for (unsigned int j = 0; j < n_v_dofs; j++)
-                {
-                    Kpv(i, j) += -JxW[qp] * psi[i][qp] * dphi[j][qp](1);
-                }
-                
-                
-            Gradient du(stateAdj_.get_system(problem_.name_).point_gradient(u_var, xyz[qp]));
-            Gradient dv(stateAdj_.get_system(problem_.name_).point_gradient(v_var, xyz[qp]));
+            Gradient du;
+            Gradient dv;
+            
+            for (unsigned int j = 0; j < state_dof_indices_u.size(); j++)
+            {
+                du.add_scaled(dphi[j][qp], state.current_solution(state_dof_indices_u[j]));
+            }
+            
+            for (unsigned int j = 0; j < state_dof_indices_v.size(); j++)
+            {
+                dv.add_scaled(dphi[j][qp], state.current_solution(state_dof_indices_v[j]));
+            }
             
             for (unsigned int i = 0; i < n_u_dofs; i++)
             {
@@ -731,10 +815,9 @@ void StokesEnergyAdjoint::assemble()
             }
         } // end of the quadrature point qp-loop
         
-        dof_map.constrain_element_matrix_and_vector (Ke, Fe, dof_indices);
+        dof_map.constrain_element_vector (Fe, dof_indices);
         
-        system.matrix->add_matrix (Ke, dof_indices);
-        system.rhs->add_vector    (Fe, dof_indices);
+        buffer.add (Fe, dof_indices);
     } // end of element loop
     
     return;
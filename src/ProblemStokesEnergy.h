@@ -18,6 +18,8 @@
 #define PROBLEMSTOKESENERGY_H
 
 #include "Problem.h"
+#include "StokesBlockPreconditioner.h"
+
 /**
  * @class ProblemStokesEnergy
  * @brief Classe che eredita da Problem e che rappresenta il problema di Stokes
@@ -58,6 +60,12 @@ class ProblemStokesEnergy : public Problem
          */
         virtual Real computeGradient(EquationSystems &, const Point &) const;
         
+        /** @copydoc Problem::computeGradient(EquationSystems &, const BoundaryQuadratureCache::Side &, std::vector<Real> &) const */
+        virtual void computeGradient(EquationSystems &, const BoundaryQuadratureCache::Side &, std::vector<Real> &) const;
+        
+        /** @copydoc Problem::computeGradient(EquationSystems &, const Elem *, const Point &) const */
+        virtual Real computeGradient(EquationSystems &, const Elem *, const Point &) const;
+        
         /**
          * @brief Metodo per calcolare la norma @f$ L^2 @f$ del gradiente
          * @param[in] stateAdj : Sistema d'equazioni che contiene lo stato e l'aggiunto
@@ -75,10 +83,14 @@ class ProblemStokesEnergy : public Problem
         virtual void fixCP(const MatrixXp &, MatrixXp &) const;
         /** @copydoc Problem::lagrangeMult(EquationSystems &) */
         virtual Real lagrangeMult(EquationSystems &) const;
+        /** @copydoc Problem::evaluateBoundaryFunctionals(EquationSystems &) */
+        virtual BoundaryFunctionals evaluateBoundaryFunctionals(EquationSystems &) const;
         
     protected:
         Real ux_;   /**< @brief Componente lungo l'asse @f$ x @f$ della velocità in ingresso */
         Real uy_;   /**< @brief Componente lungo l'asse @f$ y @f$ della velocità in ingresso */
+        
+        mutable std::shared_ptr<StokesBlockPreconditioner> preconditioner_; /**< @brief Precondizionatore a blocchi dello stato e dell'aggiunto, nullo con il risolutore diretto */
 };
 
 
@@ -104,6 +116,14 @@ class StokesEnergyHE : public System::Assembly
         void assemble();    /**< @brief Assembla le matrici e i vettori per calcolare l'estensione armonica nel problema dell'elasticità */
         
     private:
+        /**
+         * @brief Assembla gli elementi di un intervallo, con oggetti FE e matrici elementari propri del thread chiamante
+         * @param[in]  range  : intervallo di elementi
+         * @param[out] buffer : contributi elementari del thread
+         *
+         */
+        void assembleRange(const ConstElemRange &, AssemblyBuffer &);
+        
         EquationSystems & perturbation_;    /**< @brief Sistemi d'equazioni per gestire lo spostamento della mesh */
         EquationSystems & stateAdj_;        /**< @brief Sistemi d'equazioni contenente lo stato e l'aggiunto */
         Real lagrange_;                     /**< @brief Moltiplicatore di lagrange */
@@ -130,6 +150,14 @@ class StokesEnergyState : public System::Assembly
         void assemble();    /**< @brief Assembla le matrici e i vettori per calcolare lo stato nel problema di Stokes */
         
     private:
+        /**
+         * @brief Assembla gli elementi di un intervallo, con oggetti FE e matrici elementari propri del thread chiamante
+         * @param[in]  range  : intervallo di elementi
+         * @param[out] buffer : contributi elementari del thread
+         *
+         */
+        void assembleRange(const ConstElemRange &, AssemblyBuffer &);
+        
         EquationSystems & stateAdj_;    /**< @brief Sistemi d'equazioni contenente lo stato e l'aggiunto */
         
         const ProblemStokesEnergy & problem_;   /**< @brief Riferimento costante al problema di Stokes */
@@ -151,9 +179,17 @@ class StokesEnergyAdjoint : public System::Assembly
          */
         StokesEnergyAdjoint(EquationSystems &, const ProblemStokesEnergy &);
         
-        void assemble();    /**< @brief Assembla le matrici e i vettori per calcolare l'aggiunto nel problema di Stokes*/
+        void assemble();    /**< @brief Assembla il termine noto dell'aggiunto nel problema di Stokes: l'operatore è lo stesso dello stato */
         
     private:
+        /**
+         * @brief Assembla gli elementi di un intervallo, con oggetti FE e matrici elementari propri del thread chiamante
+         * @param[in]  range  : intervallo di elementi
+         * @param[out] buffer : contributi elementari del thread
+         *
+         */
+        void assembleRange(const ConstElemRange &, AssemblyBuffer &);
+        
         EquationSystems & stateAdj_;    /**< @brief Sistemi d'equazioni contenente lo stato e l'aggiunto */
         
         const ProblemStokesEnergy & problem_;   /**< @brief Riferimento costante al problema di Stokes */
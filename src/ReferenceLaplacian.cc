@@ -0,0 +1,128 @@
+#include "ReferenceLaplacian.h"
+
+ReferenceLaplacian::ReferenceLaplacian(const FEType & fe_type)
+    : fe_type_(fe_type), initialized_(false) {}
+
+void ReferenceLaplacian::init(const MeshBase & mesh, const std::set<boundary_id_type> & dirichlet_ids)
+{
+    const unsigned int dim = mesh.mesh_dimension();
+    const dof_id_type n_nodes = mesh.max_node_id();
+    
+    AutoPtr<FEBase> fe (FEBase::build(dim, fe_type_));
+    QGauss qrule (dim, fe_type_.default_quadrature_order());
+    fe->attach_quadrature_rule (&qrule);
+    
+    const std::vector<Real>& JxW = fe->get_JxW();
+    const std::vector<std::vector<RealGradient> >& dphi = fe->get_dphi();
+    
+    MeshBase::const_element_iterator       el     = mesh.active_local_elements_begin();
+    const MeshBase::const_element_iterator end_el = mesh.active_local_elements_end();
+    
+    // Dirichlet nodes.
+    dirichlet_.assign(n_nodes, false);
+    
+    for ( ; el != end_el; ++el)
+    {
+        const Elem* elem = *el;
+        
+        for (unsigned int side = 0; side < elem->n_sides(); side++)
+        {
+            if ( elem->neighbor(side) != NULL )
+            {
+                continue;
+            }
+            
+            const std::vector<boundary_id_type> ids = mesh.boundary_info->boundary_ids(elem, side);
+            
+            for (std::size_t b = 0; b < ids.size(); b++)
+            {
+                if ( dirichlet_ids.count(ids[b]) )
+                {
+                    for (unsigned int n = 0; n < elem->n_nodes(); n++)
+                    {
+                        if ( elem->is_node_on_side(n, side) )
+                        {
+                            dirichlet_[elem->get_node(n)->id()] = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    // Stiffness matrix, with the Dirichlet rows and columns replaced by the identity.
+    std::vector<Triplet<Real> > triplets;
+    
+    for (el = mesh.active_local_elements_begin(); el != end_el; ++el)
+    {
+        const Elem* elem = *el;
+        
+        fe->reinit (elem);
+        
+        libmesh_assert_equal_to (dphi.size(), elem->n_nodes());
+        
+        for (unsigned int i = 0; i < dphi.size(); i++)
+        {
+            const dof_id_type node_i = elem->get_node(i)->id();
+            
+            if ( dirichlet_[node_i] )
+            {
+                continue;
+            }
+            
+            for (unsigned int j = 0; j < dphi.size(); j++)
+            {
+                const dof_id_type node_j = elem->get_node(j)->id();
+                
+                if ( dirichlet_[node_j] )
+                {
+                    continue;
+                }
+                
+                Real value = 0.0;
+                
+                for (unsigned int qp = 0; qp < qrule.n_points(); qp++)
+                {
+                    value += JxW[qp] * (dphi[i][qp] * dphi[j][qp]);
+                }
+                
+                triplets.push_back(Triplet<Real>(node_i, node_j, value));
+            }
+        }
+    }
+    
+    for (dof_id_type n = 0; n < n_nodes; n++)
+    {
+        if ( dirichlet_[n] || mesh.query_node_ptr(n) == NULL )
+        {
+            triplets.push_back(Triplet<Real>(n, n, 1.0));
+        }
+    }
+    
+    SparseXr matrix(n_nodes, n_nodes);
+    matrix.setFromTriplets(triplets.begin(), triplets.end());
+    
+    ldlt_.compute(matrix);
+    
+    if ( ldlt_.info() != Success )
+    {
+        throw std::runtime_error("ReferenceLaplacian::init(): the factorization of the Laplacian failed.");
+    }
+    
+    initialized_ = true;
+}
+
+void ReferenceLaplacian::solve(const MatrixXr & rhs, MatrixXr & solution) const
+{
+    MatrixXr constrained_rhs(rhs);
+    
+    for (Index n = 0; n < constrained_rhs.rows(); n++)
+    {
+        if ( dirichlet_[n] )
+        {
+            constrained_rhs.row(n).setZero();
+        }
+    }
+    
+    solution = ldlt_.solve(constrained_rhs);
+}
@@ -0,0 +1,81 @@
+/* C++ */
+
+/**
+ * @file   ReferenceLaplacian.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef REFERENCELAPLACIAN_H
+#define REFERENCELAPLACIAN_H
+
+#include "typedefs.h"
+
+/**
+ * @class ReferenceLaplacian
+ *
+ * @brief Classe che assembla e fattorizza una sola volta il laplaciano scalare sulla mesh di riferimento
+ *
+ * Le due componenti dell'estensione armonica hanno lo stesso operatore: vengono quindi calcolate
+ * come due termini noti dello stesso sistema scalare, con condizioni di Dirichlet omogenee.
+ * Le incognite sono indicizzate con l'identificativo dei nodi della mesh, per cui
+ * le funzioni di base devono avere un grado di libertà per ogni nodo (es. elementi di Lagrange
+ * del secondo ordine su una mesh del secondo ordine).
+ *
+ */
+class ReferenceLaplacian
+{
+    public:
+        /**
+         * @brief Costruttore
+         * @param[in] fe_type : Tipo di elemento finito
+         *
+         */
+        ReferenceLaplacian(const FEType &);
+        
+        /**
+         * @brief Assembla e fattorizza il laplaciano
+         * @param[in] mesh          : mesh di riferimento
+         * @param[in] dirichlet_ids : identificativi dei bordi su cui l'estensione è nulla
+         *
+         */
+        void init(const MeshBase &, const std::set<boundary_id_type> &);
+        
+        /**
+         * @brief Verifica se il laplaciano è già stato fattorizzato
+         * @return vero se init() è già stato chiamato
+         *
+         */
+        inline bool isInitialized() const;
+        
+        /**
+         * @brief Risolve il sistema per più termini noti
+         * @param[in]  rhs      : termini noti, una colonna per ogni componente, righe indicizzate per nodo
+         * @param[out] solution : soluzioni, con la stessa struttura di @a rhs
+         *
+         */
+        void solve(const MatrixXr &, MatrixXr &) const;
+        
+    private:
+        FEType fe_type_;                    /**< @brief tipo di elemento finito */
+        
+        SimplicialLDLT<SparseXr> ldlt_;     /**< @brief fattorizzazione del laplaciano */
+        std::vector<bool> dirichlet_;       /**< @brief per ogni nodo, vero se appartiene a un bordo di Dirichlet */
+        
+        bool initialized_;                  /**< @brief vero se il laplaciano è stato fattorizzato */
+};
+
+inline bool ReferenceLaplacian::isInitialized() const
+{
+    return initialized_;
+}
+
+#endif /* REFERENCELAPLACIAN_H */
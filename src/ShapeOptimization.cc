@@ -1,7 +1,7 @@
 #include "ShapeOptimization.h"
 
 ShapeOptimization::ShapeOptimization(const Problem & problem, const std::string & directory, const Real & step, const Index & maxIterationsNo, const Real & tolerance, const bool & volume_constraint, const Real & armijoSlope)
-    : problem_(problem), plotName_(directory + "/" + problem_.get_name()), mesh_(problem_.get_mesh()), step_(step), maxIterationsNo_(maxIterationsNo), tolerance_(tolerance), volume_constraint_(volume_constraint), armijoSlope_(armijoSlope), initialVolume_(getVolume())
+    : problem_(problem), plotName_(directory + "/" + problem_.get_name()), mesh_(problem_.get_mesh()), step_(step), maxIterationsNo_(maxIterationsNo), tolerance_(tolerance), volume_constraint_(volume_constraint), armijoSlope_(armijoSlope), persistent_systems_(false), initialVolume_(getVolume()), deformer_(*mesh_, problem_)
 {}
 
 void ShapeOptimization::apply()
@@ -15,9 +15,29 @@ void ShapeOptimization::apply()
     Real costFunction = 0.0;
     Real costFunctionOld = 0.0;
     
+    // Boundary integrals of the current state, evaluated in a single pass.
+    BoundaryFunctionals functionals;
+    Real gradJ2 = 0.0;
+    
     // Armijo's rule.
     bool approved = false;
-    std::shared_ptr<Mesh> meshOld;
+    VectorXr coordinatesOld;
+    
+    // The perturbation of the Stokes problem lives on a copy of the mesh,
+    // since its systems would otherwise overwrite the DOF numbering of the state.
+    // The copy is made once: afterwards only its node coordinates are updated.
+    std::shared_ptr<Mesh> meshPerturbation = mesh_;
+    
+    if ( problem_.get_name() == "StokesEnergy" )
+    {
+        meshPerturbation = std::shared_ptr<Mesh>(new Mesh(*mesh_));
+    }
+    
+    if ( persistent_systems_ )
+    {
+        stateAdj = std::shared_ptr<EquationSystems>(new EquationSystems(*mesh_));
+        perturbation = std::shared_ptr<EquationSystems>(new EquationSystems(*meshPerturbation));
+    }
     
     // Save the reference mesh.
     mesh_->write(plotName_ + "_ReferenceMesh.vtu");
@@ -34,47 +54,61 @@ void ShapeOptimization::apply()
         std::string stateAdj_name = plotName_ + "_StateAndAdjoint" + std::to_string(i) + ".vtk";
         std::string perturbation_name = plotName_ + "_Perturbation" + std::to_string(i) + ".vtk";
         
-        if ( i == 1 || !approved )
+        if ( i == 1 )
         {
-            stateAdj = std::shared_ptr<EquationSystems>(new EquationSystems(*mesh_));
+            if ( !persistent_systems_ )
+            {
+                stateAdj = std::shared_ptr<EquationSystems>(new EquationSystems(*mesh_));
+            }
+            
             problem_.resolveStateAndAdjointEquation(*stateAdj, i);
             
             VTKIO (*mesh_).write_equation_systems(stateAdj_name, *stateAdj);
             
-            costFunctionOld = problem_.evaluateCostFunction(*stateAdj);
+            functionals = problem_.evaluateBoundaryFunctionals(*stateAdj);
+            costFunctionOld = functionals.cost;
         }
         
-        meshOld = std::shared_ptr<Mesh>(new Mesh(*mesh_));
-        
-        if ( volume_constraint_ )
+        // After a rejected trial the mesh has been restored and the accepted state,
+        // its functionals and the perturbation are still valid: only a new trial step is needed.
+        if ( i == 1 || approved )
         {
-            if ( i == 1 )
+            saveCoordinates(*mesh_, coordinatesOld);
+            saveParameters();
+            
+            if ( volume_constraint_ )
+            {
+                if ( i == 1 )
+                {
+                    old_lagrange_ = functionals.lagrange;
+                }
+                
+                updateLagrange(functionals.lagrange);
+                std::cout << "Lagrange multiplier = " << actual_lagrange_ << std::endl << std::endl;
+            }
+            
+            if ( meshPerturbation != mesh_ )
             {
-                old_lagrange_ = problem_.lagrangeMult(*stateAdj);
+                restoreCoordinates(coordinatesOld, *meshPerturbation);
             }
             
-            updateLagrange(problem_.lagrangeMult(*stateAdj));
-            std::cout << "Lagrange multiplier = " << actual_lagrange_ << std::endl << std::endl;
-        }
-        
-        Mesh mesh_perturbation(*mesh_);
-        
-        if ( problem_.get_name() == "Elasticity" )
-        {
-            perturbation = std::shared_ptr<EquationSystems>(new EquationSystems(*mesh_));
-        }
-        else if ( problem_.get_name() == "StokesEnergy" )
-        {
-            perturbation = std::shared_ptr<EquationSystems>(new EquationSystems(mesh_perturbation));
+            if ( !persistent_systems_ )
+            {
+                perturbation = std::shared_ptr<EquationSystems>(new EquationSystems(*meshPerturbation));
+            }
+            
+            // Gradient norm at the current design, needed by Armijo's rule.
+            gradJ2 = functionals.gradJ2;
+            
+            std::cout << "Computing the identity perturbation" << std::endl;
+            computePerturbation(*perturbation, *stateAdj);
+            
+            VTKIO (*meshPerturbation).write_equation_systems (perturbation_name, *perturbation);
         }
         
-        std::cout << "Computing the identity perturbation" << std::endl;
-        computePerturbation(*perturbation, *stateAdj);
-        
-        VTKIO (mesh_perturbation).write_equation_systems (perturbation_name, *perturbation);
-        
         std::cout << "Deforming the mesh" << std::endl;
         applyPerturbation(*perturbation);
+        problem_.invalidateBoundaryCache();
         std::cout << "    Done." << std::endl << std::endl;
         
         try
@@ -95,12 +129,16 @@ void ShapeOptimization::apply()
         
         // Armijo's rule.
         std::cout << "*** Armijo's rule ***" << std::endl << std::endl;
-        Real gradJ2 = problem_.sqrGradient(*stateAdj);
         
-        stateAdj = std::shared_ptr<EquationSystems>(new EquationSystems(*mesh_));
+        if ( !persistent_systems_ )
+        {
+            stateAdj = std::shared_ptr<EquationSystems>(new EquationSystems(*mesh_));
+        }
+        
         problem_.resolveStateAndAdjointEquation(*stateAdj, i);
         
-        costFunction = problem_.evaluateCostFunction(*stateAdj);
+        functionals = problem_.evaluateBoundaryFunctionals(*stateAdj);
+        costFunction = functionals.cost;
         
         std::cout << std::endl << "New cost function = " << costFunction << std::endl << std::endl;
         
@@ -116,7 +154,10 @@ void ShapeOptimization::apply()
             
             std::cout << "Step updated! New step = " << step_ << std::endl << std::endl;
             
-            mesh_ = std::move(meshOld);
+            // Restore the nodes in place, so that the systems built on the mesh stay valid.
+            restoreCoordinates(coordinatesOld, *mesh_);
+            restoreParameters();
+            problem_.invalidateBoundaryCache();
         }
         else
         {
@@ -166,6 +207,53 @@ void ShapeOptimization::apply()
     pvd_out.close();
 }
 
+void ShapeOptimization::set_persistent_systems(const bool & persistent_systems)
+{
+    persistent_systems_ = persistent_systems;
+}
+
+void ShapeOptimization::saveCoordinates(const MeshBase & mesh, VectorXr & coordinates)
+{
+    coordinates = VectorXr::Zero(LIBMESH_DIM * mesh.max_node_id());
+    
+    MeshBase::const_node_iterator       nd     = mesh.nodes_begin();
+    const MeshBase::const_node_iterator end_nd = mesh.nodes_end();
+    
+    for ( ; nd != end_nd; ++nd )
+    {
+        const Node & node = **nd;
+        
+        for ( unsigned int i = 0; i < LIBMESH_DIM; ++i )
+        {
+            coordinates(LIBMESH_DIM * node.id() + i) = node(i);
+        }
+    }
+}
+
+void ShapeOptimization::restoreCoordinates(const VectorXr & coordinates, MeshBase & mesh)
+{
+    libmesh_assert_equal_to(coordinates.size(), LIBMESH_DIM * mesh.max_node_id());
+    
+    MeshBase::node_iterator       nd     = mesh.nodes_begin();
+    const MeshBase::node_iterator end_nd = mesh.nodes_end();
+    
+    for ( ; nd != end_nd; ++nd )
+    {
+        Node & node = **nd;
+        
+        for ( unsigned int i = 0; i < LIBMESH_DIM; ++i )
+        {
+            node(i) = coordinates(LIBMESH_DIM * node.id() + i);
+        }
+    }
+}
+
+void ShapeOptimization::saveParameters()
+{}
+
+void ShapeOptimization::restoreParameters()
+{}
+
 void ShapeOptimization::updateLagrange(const Real & lagrange)
 {
     actual_lagrange_ = 0.5 * (old_lagrange_ + lagrange) + (getVolume() - initialVolume_) / initialVolume_;
@@ -19,6 +19,7 @@
 
 #include "typedefs.h"
 
+#include "MeshDeformer.h"
 #include "Problem.h"
 #include "ProblemElasticity.h"
 #include "ProblemStokesEnergy.h"
@@ -74,6 +75,29 @@ class ShapeOptimization
          */
         virtual void applyPerturbation(const EquationSystems & perturbation) = 0;
         
+        /**
+         * @brief Salva i parametri della tecnica che applyPerturbation() modifica, prima di un passo di prova
+         *
+         * L'implementazione di default non fa nulla: le tecniche che deformano direttamente i nodi
+         * vengono ripristinate da restoreCoordinates().
+         *
+         */
+        virtual void saveParameters();
+        
+        /**
+         * @brief Ripristina i parametri salvati da saveParameters() quando il passo di prova viene rifiutato
+         *
+         */
+        virtual void restoreParameters();
+        
+        /**
+         * @brief Imposta il riutilizzo dei sistemi d'equazioni tra un'iterazione e l'altra
+         * @param[in] persistent_systems : se vero, stato, aggiunto e perturbazione vengono costruiti una sola volta
+         * e soltanto riassemblati e risolti dopo ogni deformazione della mesh
+         *
+         */
+        void set_persistent_systems(const bool &);
+        
         /**
          * @brief Aggiorna il valore del moltiplicatore di lagrange
          * @f$ l_{k+1} = \frac{ l + l_k}{2} + \frac{ V - V_0 }{ V_0 } @f$
@@ -97,6 +121,22 @@ class ShapeOptimization
         void checkDomain() const;
         
     protected:
+        /**
+         * @brief Salva le coordinate dei nodi di una mesh in un vettore
+         * @param[in]  mesh        : mesh da cui leggere le coordinate
+         * @param[out] coordinates : coordinate dei nodi, memorizzate consecutivamente nodo per nodo in base all'indice del nodo
+         *
+         */
+        static void saveCoordinates(const MeshBase &, VectorXr &);
+        
+        /**
+         * @brief Ripristina le coordinate dei nodi di una mesh, senza modificarne la connettività
+         * @param[in]  coordinates : coordinate salvate con saveCoordinates(), anche da un'altra mesh con la stessa numerazione dei nodi
+         * @param[out] mesh        : mesh in cui scrivere le coordinate
+         *
+         */
+        static void restoreCoordinates(const VectorXr &, MeshBase &);
+        
         const Problem & problem_;       /**< @brief problema che si vuole ottimizzare */
         std::string plotName_;          /**< @brief nome utilizzato nella generazione dei file di output */
         
@@ -107,11 +147,14 @@ class ShapeOptimization
         Real tolerance_;                /**< @brief tolleranza per il test d'arresto dell'incremento relativo */
         bool volume_constraint_;        /**< @brief specifica se applicare o meno il vincolo di volume */
         Real armijoSlope_;              /**< @brief coefficiente di rilassamento per la regola di Armijo */
+        bool persistent_systems_;       /**< @brief specifica se riutilizzare i sistemi d'equazioni tra le iterazioni */
         
         Real old_lagrange_;             /**< @brief valore del lagrangiano al passo d'ottimizzazione precedente */
         Real actual_lagrange_;          /**< @brief valore del lagrangiano al passo d'ottimizzazione attuale */
         
         Real initialVolume_;            /**< @brief area iniziale della mesh */
+        
+        MeshDeformer deformer_;         /**< @brief sposta i vertici e ricostruisce i nodi interni ai lati */
 };
 
 #endif /* SHAPEOPTIMIZATION_H */
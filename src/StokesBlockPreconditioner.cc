@@ -0,0 +1,146 @@
+#include "StokesBlockPreconditioner.h"
+
+StokesBlockPreconditioner::StokesBlockPreconditioner(const Parallel::Communicator & comm)
+    : Preconditioner<Number>(comm), n_velocity_(0), n_pressure_(0) {}
+
+void StokesBlockPreconditioner::init()
+{
+    this->_is_initialized = true;
+}
+
+void StokesBlockPreconditioner::begin(const System & system, const unsigned int & p_var)
+{
+    if ( system.n_processors() > 1 )
+    {
+        throw std::runtime_error("StokesBlockPreconditioner::begin(): the block preconditioner only supports serial runs.");
+    }
+    
+    const DofMap & dof_map = system.get_dof_map();
+    const MeshBase & mesh = system.get_mesh();
+    
+    is_pressure_.assign(system.n_dofs(), false);
+    block_index_.assign(system.n_dofs(), -1);
+    
+    std::vector<dof_id_type> dof_indices_p;
+    
+    MeshBase::const_element_iterator       el     = mesh.active_local_elements_begin();
+    const MeshBase::const_element_iterator end_el = mesh.active_local_elements_end();
+    
+    for ( ; el != end_el; ++el)
+    {
+        dof_map.dof_indices (*el, dof_indices_p, p_var);
+        
+        for (unsigned int i = 0; i < dof_indices_p.size(); i++)
+        {
+            is_pressure_[dof_indices_p[i]] = true;
+        }
+    }
+    
+    n_velocity_ = 0;
+    n_pressure_ = 0;
+    
+    for (dof_id_type i = 0; i < is_pressure_.size(); i++)
+    {
+        block_index_[i] = is_pressure_[i] ? n_pressure_++ : n_velocity_++;
+    }
+    
+    // The number of contributions does not change between two assemblies.
+    const std::size_t n_A_triplets = A_triplets_.size();
+    const std::size_t n_Bt_triplets = Bt_triplets_.size();
+    const std::size_t n_M_triplets = M_triplets_.size();
+    
+    A_triplets_.clear();
+    Bt_triplets_.clear();
+    M_triplets_.clear();
+    
+    A_triplets_.reserve(n_A_triplets);
+    Bt_triplets_.reserve(n_Bt_triplets);
+    M_triplets_.reserve(n_M_triplets);
+}
+
+void StokesBlockPreconditioner::add(const DenseMatrix<Number> & Ke, const std::vector<dof_id_type> & dof_indices, const DenseMatrix<Number> & Me, const std::vector<dof_id_type> & dof_indices_p)
+{
+    for (unsigned int i = 0; i < dof_indices.size(); i++)
+    {
+        if ( is_pressure_[dof_indices[i]] )
+        {
+            continue;
+        }
+        
+        const Index row = block_index_[dof_indices[i]];
+        
+        for (unsigned int j = 0; j < dof_indices.size(); j++)
+        {
+            const Index col = block_index_[dof_indices[j]];
+            
+            if ( is_pressure_[dof_indices[j]] )
+            {
+                Bt_triplets_.push_back(Triplet<Real>(row, col, Ke(i, j)));
+            }
+            else
+            {
+                A_triplets_.push_back(Triplet<Real>(row, col, Ke(i, j)));
+            }
+        }
+    }
+    
+    for (unsigned int i = 0; i < dof_indices_p.size(); i++)
+    {
+        for (unsigned int j = 0; j < dof_indices_p.size(); j++)
+        {
+            M_triplets_.push_back(Triplet<Real>(block_index_[dof_indices_p[i]], block_index_[dof_indices_p[j]], Me(i, j)));
+        }
+    }
+}
+
+void StokesBlockPreconditioner::setup()
+{
+    SparseXr A(n_velocity_, n_velocity_);
+    SparseXr M(n_pressure_, n_pressure_);
+    
+    A.setFromTriplets(A_triplets_.begin(), A_triplets_.end());
+    M.setFromTriplets(M_triplets_.begin(), M_triplets_.end());
+    
+    Bt_.resize(n_velocity_, n_pressure_);
+    Bt_.setFromTriplets(Bt_triplets_.begin(), Bt_triplets_.end());
+    
+    A_ldlt_.compute(A);
+    M_ldlt_.compute(M);
+    
+    if ( A_ldlt_.info() != Success || M_ldlt_.info() != Success )
+    {
+        throw std::runtime_error("StokesBlockPreconditioner::setup(): the factorization of the diagonal blocks failed.");
+    }
+}
+
+void StokesBlockPreconditioner::apply(const NumericVector<Number> & x, NumericVector<Number> & y)
+{
+    std::vector<Number> x_local;
+    x.localize(x_local);
+    
+    VectorXr x_u(n_velocity_);
+    VectorXr x_p(n_pressure_);
+    
+    for (dof_id_type i = 0; i < x_local.size(); i++)
+    {
+        if ( is_pressure_[i] )
+        {
+            x_p(block_index_[i]) = x_local[i];
+        }
+        else
+        {
+            x_u(block_index_[i]) = x_local[i];
+        }
+    }
+    
+    // Backward substitution with the upper triangular block matrix.
+    const VectorXr y_p = - M_ldlt_.solve(x_p);
+    const VectorXr y_u = A_ldlt_.solve(x_u - Bt_ * y_p);
+    
+    for (dof_id_type i = 0; i < x_local.size(); i++)
+    {
+        y.set(i, is_pressure_[i] ? y_p(block_index_[i]) : y_u(block_index_[i]));
+    }
+    
+    y.close();
+}
@@ -0,0 +1,108 @@
+/* C++ */
+
+/**
+ * @file   StokesBlockPreconditioner.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef STOKESBLOCKPRECONDITIONER_H
+#define STOKESBLOCKPRECONDITIONER_H
+
+#include "typedefs.h"
+
+/**
+ * @class StokesBlockPreconditioner
+ *
+ * @brief Precondizionatore a blocchi triangolare superiore per il problema di punto sella di Stokes
+ *
+ * Data la matrice @f$ \begin{bmatrix} A & B^T \\ B & 0 \end{bmatrix} @f$, il precondizionatore è
+ * @f$ P = \begin{bmatrix} A & B^T \\ 0 & -M_p \end{bmatrix} @f$, dove la matrice di massa della pressione
+ * @f$ M_p @f$ approssima il complemento di Schur @f$ B A^{-1} B^T @f$.
+ * I blocchi vengono raccolti dalle matrici elementari già vincolate durante l'assemblaggio dello stato;
+ * @f$ A @f$ e @f$ M_p @f$ vengono fattorizzate in setup(), chiamato dal solutore quando la matrice cambia.
+ * Il numero di iterazioni del metodo di Krylov non cresce quindi con il raffinamento della mesh.
+ *
+ */
+class StokesBlockPreconditioner : public Preconditioner<Number>
+{
+    public:
+        /**
+         * @brief Costruttore
+         * @param[in] comm : comunicatore
+         *
+         */
+        StokesBlockPreconditioner(const Parallel::Communicator &);
+        
+        /**
+         * @brief Distruttore (defaulted)
+         *
+         */
+        virtual ~StokesBlockPreconditioner() = default;
+        
+        /**
+         * @brief Segna il precondizionatore come inizializzato
+         *
+         */
+        virtual void init();
+        
+        /**
+         * @brief Costruisce e fattorizza i blocchi raccolti durante l'ultimo assemblaggio
+         *
+         */
+        virtual void setup();
+        
+        /**
+         * @brief Applica il precondizionatore
+         * @param[in]  x : vettore a cui applicare @f$ P^{-1} @f$
+         * @param[out] y : risultato
+         *
+         */
+        virtual void apply(const NumericVector<Number> &, NumericVector<Number> &);
+        
+        /**
+         * @brief Prepara la raccolta dei blocchi, classificando i gradi di libertà in velocità e pressione
+         * @param[in] system : sistema di Stokes da assemblare
+         * @param[in] p_var  : indice della variabile di pressione
+         *
+         */
+        void begin(const System &, const unsigned int &);
+        
+        /**
+         * @brief Aggiunge il contributo di un elemento
+         * @param[in] Ke            : matrice elementare, già vincolata
+         * @param[in] dof_indices   : indici globali dei gradi di libertà dell'elemento
+         * @param[in] Me            : matrice di massa elementare della pressione
+         * @param[in] dof_indices_p : indici globali dei gradi di libertà di pressione dell'elemento
+         *
+         * Viene chiamato in serie, dopo l'assemblaggio parallelo, con i contributi raccolti da AssemblyBuffer.
+         *
+         */
+        void add(const DenseMatrix<Number> &, const std::vector<dof_id_type> &, const DenseMatrix<Number> &, const std::vector<dof_id_type> &);
+        
+    private:
+        std::vector<bool> is_pressure_;                 /**< @brief per ogni grado di libertà, vero se è di pressione */
+        std::vector<Index> block_index_;                /**< @brief per ogni grado di libertà, indice nel proprio blocco */
+        
+        Index n_velocity_;                              /**< @brief numero di gradi di libertà di velocità */
+        Index n_pressure_;                              /**< @brief numero di gradi di libertà di pressione */
+        
+        std::vector<Triplet<Real> > A_triplets_;        /**< @brief contributi al blocco di velocità */
+        std::vector<Triplet<Real> > Bt_triplets_;       /**< @brief contributi al blocco velocità-pressione */
+        std::vector<Triplet<Real> > M_triplets_;        /**< @brief contributi alla matrice di massa della pressione */
+        
+        SparseXr Bt_;                                   /**< @brief blocco velocità-pressione */
+        
+        SimplicialLDLT<SparseXr> A_ldlt_;               /**< @brief fattorizzazione del blocco di velocità */
+        SimplicialLDLT<SparseXr> M_ldlt_;               /**< @brief fattorizzazione della matrice di massa della pressione */
+};
+
+#endif /* STOKESBLOCKPRECONDITIONER_H */
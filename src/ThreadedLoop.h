@@ -0,0 +1,125 @@
+/* C++ */
+
+/**
+ * @file   ThreadedLoop.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef THREADEDLOOP_H
+#define THREADEDLOOP_H
+
+#include "typedefs.h"
+
+#include <exception>
+#include <functional>
+
+/**
+ * @class ThreadedLoop
+ *
+ * @brief Classe che esegue i cicli paralleli con lo strato di threading di libMesh, con un'unica gestione degli errori
+ *
+ * Il ciclo viene diviso da @c Threads::parallel_for tra i thread richiesti a libMesh con @c --n_threads;
+ * se libMesh è compilato senza thread il ciclo viene eseguito in serie. Un'eccezione lanciata in un thread
+ * non può attraversarne il confine: viene catturata e la prima viene rilanciata al termine del ciclo.
+ *
+ */
+class ThreadedLoop
+{
+    public:
+        /**
+         * @brief Esegue un ciclo parallelo su un intervallo
+         * @param[in] range : intervallo da dividere tra i thread, ad esempio @c ConstElemRange o @c Threads::BlockedRange
+         * @param[in] body  : funzione che elabora un sottointervallo
+         *
+         */
+        template <typename Range>
+        static void run(const Range &, const std::function<void (const Range &)> &);
+        
+        /**
+         * @brief Esegue un ciclo parallelo sugli indici @f$ 0, \dots, n - 1 @f$
+         * @param[in] n    : numero di indici
+         * @param[in] body : funzione che elabora gli indici dell'intervallo @f$ [begin, end) @f$
+         *
+         */
+        static void run(const std::size_t &, const std::function<void (const std::size_t &, const std::size_t &)> &);
+        
+    private:
+        /**
+         * @class Body
+         * @brief Corpo del ciclo passato a @c Threads::parallel_for, che cattura le eccezioni del thread
+         *
+         */
+        template <typename Range>
+        class Body
+        {
+            public:
+                /**
+                 * @brief Costruttore
+                 * @param[in]     body      : funzione che elabora un sottointervallo
+                 * @param[in,out] mutex     : mutex che protegge @a exception
+                 * @param[in,out] exception : prima eccezione lanciata nei thread
+                 *
+                 */
+                Body(const std::function<void (const Range &)> & body, Threads::spin_mutex & mutex, std::exception_ptr & exception)
+                    : body_(body), mutex_(mutex), exception_(exception) {}
+                    
+                /**
+                 * @brief Elabora un sottointervallo
+                 * @param[in] range : sottointervallo assegnato al thread
+                 *
+                 */
+                void operator() (const Range & range) const
+                {
+                    try
+                    {
+                        body_(range);
+                    }
+                    catch ( ... )
+                    {
+                        Threads::spin_mutex::scoped_lock lock(mutex_);
+                        
+                        if ( !exception_ )
+                        {
+                            exception_ = std::current_exception();
+                        }
+                    }
+                }
+                
+            private:
+                const std::function<void (const Range &)> & body_;  /**< @brief funzione che elabora un sottointervallo */
+                Threads::spin_mutex & mutex_;                       /**< @brief mutex che protegge @a exception_ */
+                std::exception_ptr & exception_;                    /**< @brief prima eccezione lanciata nei thread */
+        };
+};
+
+template <typename Range>
+void ThreadedLoop::run(const Range & range, const std::function<void (const Range &)> & body)
+{
+    Threads::spin_mutex mutex;
+    std::exception_ptr exception;
+    
+    Threads::parallel_for(range, Body<Range>(body, mutex, exception));
+    
+    if ( exception )
+    {
+        std::rethrow_exception(exception);
+    }
+}
+
+inline void ThreadedLoop::run(const std::size_t & n, const std::function<void (const std::size_t &, const std::size_t &)> & body)
+{
+    typedef Threads::BlockedRange<std::size_t> IndexRange;
+    
+    run<IndexRange>(IndexRange(0, n), [&body](const IndexRange & range) { body(range.begin(), range.end()); });
+}
+
+#endif /* THREADEDLOOP_H */
@@ -0,0 +1,95 @@
+/* C++ */
+
+/**
+ * @file   UnivariateBasis.h
+ * @author Pasquale Claudio Africa <pasquale.africa@mail.polimi.it>, Luca Ratti <luca3.ratti@mail.polimi.it>, Abele Simona <abele.simona@mail.polimi.it>
+ * @date   2015
+ *
+ * Questo file fa parte del progetto "ShapeOpt".
+ *
+ * @copyright Copyright © 2014 Pasquale Claudio Africa, Luca Ratti, Abele Simona. All rights reserved.
+ * @copyright This project is released under the GNU General Public License.
+ *
+ * @brief Confronto tra alcune tecniche per l'ottimizzazione di forma.
+ *
+ */
+
+#ifndef UNIVARIATEBASIS_H
+#define UNIVARIATEBASIS_H
+
+#include "typedefs.h"
+
+/**
+ * @class UnivariateBasis
+ *
+ * @brief Classe astratta per una base di funzioni univariate su @f$ [0, 1] @f$, usata nelle due direzioni della FFD
+ *
+ * In ogni punto solo un intervallo contiguo di funzioni è diverso da zero: evaluateNonZero() restituisce
+ * l'indice della prima di esse e i loro valori, così che le matrici della FFD possano essere costruite sparse.
+ *
+ */
+class UnivariateBasis
+{
+    public:
+        /**
+         * @brief Distruttore (defaulted)
+         *
+         */
+        virtual ~UnivariateBasis() = default;
+        
+        /**
+         * @brief Restituisce il numero di funzioni della base
+         * @return il numero di funzioni
+         *
+         */
+        virtual Index get_size() const = 0;
+        
+        /**
+         * @brief Valuta le funzioni non nulle in un punto
+         * @param[in]  t      : punto in @f$ [0, 1] @f$
+         * @param[out] first  : indice della prima funzione non nulla
+         * @param[out] values : valori delle funzioni non nulle, a partire da @a first
+         *
+         */
+        virtual void evaluateNonZero(const Real &, Index &, VectorXr &) const = 0;
+        
+        /**
+         * @brief Valuta tutte le funzioni in un punto
+         * @param[in]  t      : punto in @f$ [0, 1] @f$
+         * @param[out] values : vettore di get_size() componenti con i valori delle funzioni
+         *
+         */
+        void evaluate(const Real &, VectorXr &) const;
+        
+        /**
+         * @brief Valuta una singola funzione in un punto
+         * @param[in] t : punto in @f$ [0, 1] @f$
+         * @param[in] k : indice della funzione
+         * @return il valore della funzione
+         *
+         */
+        virtual Real value(const Real &, const Index &) const;
+};
+
+inline void UnivariateBasis::evaluate(const Real & t, VectorXr & values) const
+{
+    Index first;
+    VectorXr nonzero;
+    
+    evaluateNonZero(t, first, nonzero);
+    
+    values = VectorXr::Zero(get_size());
+    values.segment(first, nonzero.size()) = nonzero;
+}
+
+inline Real UnivariateBasis::value(const Real & t, const Index & k) const
+{
+    Index first;
+    VectorXr nonzero;
+    
+    evaluateNonZero(t, first, nonzero);
+    
+    return ( k >= first && k < first + nonzero.size() ) ? nonzero(k - first) : 0.0;
+}
+
+#endif /* UNIVARIATEBASIS_H */
@@ -29,15 +29,22 @@
 #include "libmesh/dirichlet_boundaries.h"
 #include "libmesh/distributed_vector.h"
 #include "libmesh/dof_map.h"
+#include "libmesh/elem_range.h"
 #include "libmesh/enum_solver_type.h"
 #include "libmesh/equation_systems.h"
+#include "libmesh/explicit_system.h"
 #include "libmesh/fe.h"
+#include "libmesh/fe_interface.h"
 #include "libmesh/libmesh.h"
 #include "libmesh/linear_implicit_system.h"
 #include "libmesh/linear_solver.h"
 #include "libmesh/mesh.h"
+#include "libmesh/numeric_vector.h"
+#include "libmesh/preconditioner.h"
 #include "libmesh/quadrature_gauss.h"
+#include "libmesh/shell_matrix.h"
 #include "libmesh/sparse_matrix.h"
+#include "libmesh/threads.h"
 #include "libmesh/vtk_io.h"
 #include "libmesh/zero_function.h"
 
@@ -43,10 +43,21 @@ int main(const int argc, const char * const * argv, const char * const * envp)
          */
         const Real lambda = config("Problem/Elasticity/lambda", 13.0);
         const Real mu     = config("Problem/Elasticity/mu", 5.5);
+        const bool matrix_free = config("Problem/Elasticity/matrix_free", false);
+        const std::string cost_evaluation =
+            config("Problem/Elasticity/cost_evaluation", "compliance");
         
         const Real ux = config("Problem/StokesEnergy/ux", 4.0);
         const Real uy = config("Problem/StokesEnergy/uy", 0.0);
         
+        const std::string linear_solver =
+            config("Problem/linear_solver", "iterative");
+            
+        const std::string harmonic_extension =
+            config("Problem/harmonic_extension", "current");
+            
+        const unsigned int n_threads = config("Problem/n_threads", 1);
+        
         /**
          * Read technique-related parameters.
          */
@@ -59,6 +70,9 @@ int main(const int argc, const char * const * argv, const char * const * envp)
             
         const Real armijoSlope = config("Technique/armijoSlope", 1.0e-2);
         
+        const bool persistent_systems =
+            config("Technique/persistent_systems", true);
+        
         if ( config.vector_variable_size("Technique/boundingBoxSW") != 2
                 || config.vector_variable_size("Technique/boundingBoxNE") != 2 )
         {
@@ -79,13 +93,32 @@ int main(const int argc, const char * const * argv, const char * const * envp)
         
         std::pair<Index, Index> subdivisions(subdivisionsX, subdivisionsY);
         
+        const Index degree = config("Technique/FFD/degree", 0);
+        
         const Real beta = config("Technique/FFD_LS/beta", 0.99);
         const Index order = config("Technique/DesignElement/order", 3);
         
         /**
          * Instantiate problem.
          */
-        LibMeshInit init(argc, argv);
+        // The threads are managed by libMesh, which reads their number from the command line:
+        // the configured one is used unless --n_threads is given explicitly.
+        std::vector<std::string> arguments(argv, argv + argc);
+        
+        if ( !commandLine.search("--n_threads") )
+        {
+            arguments.push_back("--n_threads");
+            arguments.push_back(std::to_string(n_threads));
+        }
+        
+        std::vector<const char *> libmesh_argv;
+        
+        for (std::size_t i = 0; i < arguments.size(); ++i)
+        {
+            libmesh_argv.push_back(arguments[i].c_str());
+        }
+        
+        LibMeshInit init(libmesh_argv.size(), libmesh_argv.data());
         
         std::cout << "Importing the geometry..." << std::endl;
         Mesh mesh(init.comm(), 2);
@@ -97,7 +130,11 @@ int main(const int argc, const char * const * argv, const char * const * envp)
         
         if ( problemName == "Elasticity" )
         {
-            problem = new ProblemElasticity(mesh, lambda, mu);
+            ProblemElasticity * elasticity = new ProblemElasticity(mesh, lambda, mu);
+            elasticity->set_matrix_free(matrix_free);
+            elasticity->set_cost_evaluation(cost_evaluation);
+            
+            problem = elasticity;
         }
         else if ( problemName == "StokesEnergy" )
         {
@@ -109,6 +146,9 @@ int main(const int argc, const char * const * argv, const char * const * envp)
                                      " set in the configuration file.");
         }
         
+        problem->set_linear_solver(linear_solver);
+        problem->set_harmonic_extension(harmonic_extension);
+        
         directory = "Plot_" + problem->get_name() + "_" + directory;
         
         if ( system( ("rm -rf " + directory +
@@ -125,11 +165,11 @@ int main(const int argc, const char * const * argv, const char * const * envp)
         }
         else if ( techniqueName == "FFD" )
         {
-            shapeOptimization = new FFD(*problem, directory, step, maxIterationsNo, tolerance, volume_constraint, boundingBox, subdivisions, armijoSlope);
+            shapeOptimization = new FFD(*problem, directory, step, maxIterationsNo, tolerance, volume_constraint, boundingBox, subdivisions, armijoSlope, degree);
         }
         else if ( techniqueName == "FFD_LS" )
         {
-            shapeOptimization = new FFD_LS(*problem, directory, step, maxIterationsNo, tolerance, volume_constraint, boundingBox, subdivisions, beta, armijoSlope);
+            shapeOptimization = new FFD_LS(*problem, directory, step, maxIterationsNo, tolerance, volume_constraint, boundingBox, subdivisions, beta, armijoSlope, degree);
         }
         else if ( techniqueName == "DesignElement" )
         {
@@ -141,6 +181,8 @@ int main(const int argc, const char * const * argv, const char * const * envp)
                                      " set in the configuration file.");
         }
         
+        shapeOptimization->set_persistent_systems(persistent_systems);
+        
         /**
          * Apply.
          */